@@ -0,0 +1,207 @@
+#!/bin/bash
+
+# USAGE:
+# Run both engines over COUNT random workloads (default 200), seeds from SEED on,
+# ARGS go to both, e.g. --partitions 3 to check the partitioned engine
+#   ./difftest.sh [COUNT] [SEED] [ARGS...]
+# The first workload that diverges is kept as difftest.in and the run stops.
+#
+# With -c each workload runs with --checkpoint instead, then one DOOP or BLOCK
+# in it is edited and the edited workload resumes from the saved checkpoints;
+# its output must equal a fresh run of the edited workload. The first pair
+# that differs is kept as difftest.in and difftest.edit.in.
+#   ./difftest.sh -c [COUNT] [SEED] [ARGS...]
+#
+# With -t each workload is written with --trace-file, plain and with -z, and
+# tracetool must print the same lines as the trace on standard output, and the
+# same subset of them for a time window and for one process.
+#   ./difftest.sh -t [COUNT] [SEED] [ARGS...]
+#
+# With -k every workload runs twice with --cache into one shared directory,
+# a miss then a hit, and the edited workload once more, a miss; each output
+# must equal a run without the cache. First a copy of plugins/relay.so is
+# changed between runs of test 14 to check that a rebuilt plugin misses.
+#   ./difftest.sh -k [COUNT] [SEED] [ARGS...]
+
+CHECKPOINT=0 TRACEFILE=0 CACHE=
+if [ "$1" = "-c" ]; then CHECKPOINT=1; shift; fi
+if [ "$1" = "-t" ]; then TRACEFILE=1; shift; fi
+if [ "$1" = "-k" ]; then CACHE=$(mktemp -d); trap 'rm -rf $CACHE' EXIT; shift; fi
+COUNT=${1:-200}
+SEED=${2:-1}
+shift $(( $# < 2 ? $# : 2 ))
+EXE=./prosim
+POLICIES=(rr edf fair gang stride lottery)
+
+# Random workload: 2 to 6 nodes, 1 to 4 procs each, every SEND gets its RECV
+# somewhere in the partner's program, so most runs match and some deadlock.
+# Two node 0 templates are spawned at random and exit, recycling their pids.
+# One SEND or RECV in five gives up after a few ticks.
+workload() {
+	awk -v seed=$1 'function timeout() { return rand() < 0.2 ? sprintf(" TIMEOUT %d", 1 + int(rand() * 8)) : "" }
+	BEGIN {
+		srand(seed)
+		nodes = 2 + int(rand() * 5)
+		n = 0
+		for (nd = 1; nd <= nodes; ++nd) {
+			k = 1 + int(rand() * 4)
+			for (i = 1; i <= k; ++i) { n++; node[n] = nd; addr[n] = nd * 100 + i; prog[n] = "" }
+		}
+		for (step = 0; step < n * 6; ++step) {
+			p = 1 + int(rand() * n)
+			r = rand()
+			if (r < 0.1) {
+				prog[p] = prog[p] sprintf("LOOP %d\nDOOP %d\nBLOCK %d\nEND\n",
+				                          2 + int(rand() * 3), 1 + int(rand() * 4), 1 + int(rand() * 4))
+			} else if (r < 0.45) {
+				prog[p] = prog[p] sprintf("DOOP %d\n", 1 + int(rand() * 6))
+			} else if (r < 0.52) {
+				prog[p] = prog[p] sprintf("SPAWN %s %d\n", rand() < 0.5 ? "Quick" : "Slow", 1 + int(rand() * nodes))
+			} else if (r < 0.6) {
+				prog[p] = prog[p] sprintf("BLOCK %d\n", 1 + int(rand() * 6))
+			} else {
+				q = 1 + int(rand() * n)
+				if (q == p) continue
+				prog[p] = prog[p] sprintf("SEND %d%s\n", addr[q], timeout())
+				prog[q] = prog[q] sprintf("RECV %d%s\n", addr[p], timeout())
+			}
+		}
+		printf "%d %d %d\n", n + 2, nodes, 1 + int(rand() * 4)
+		for (p = 1; p <= n; ++p)
+			printf "P%d 1 %d %d\n%s%s\n\n", p, 1 + int(rand() * 4), node[p], prog[p], rand() < 0.3 ? "EXIT" : "HALT"
+		printf "Quick 1 1 0\nDOOP 1\nEXIT\n\nSlow 1 2 0\nDOOP 3\nBLOCK 2\nDOOP 1\nEXIT\n"
+	}'
+}
+
+# Edit one DOOP or BLOCK operand, picked by seed, of the workload on stdin
+edit() {
+	awk -v seed=$1 '{ line[NR] = $0; if ($0 ~ /^(DOOP|BLOCK) [0-9]+$/) pick[++n] = NR }
+	END {
+		srand(seed)
+		k = n ? pick[1 + int(rand() * n)] : 0
+		for (i = 1; i <= NR; ++i) {
+			if (i == k) { split(line[i], f, " "); line[i] = f[1] " " (f[2] + 1 + int(rand() * 4)) }
+			print line[i]
+		}
+	}'
+}
+
+# Checkpoint every few ticks, edit, resume and compare against a fresh run
+resume_check() {
+	local dir out fresh
+	dir=$(mktemp -d)
+	$EXE --checkpoint $dir --checkpoint-every 3 "$@" < difftest.in > /dev/null 2>&1
+	edit $i < difftest.in > difftest.edit.in
+	out=$($EXE --checkpoint $dir --checkpoint-every 3 "$@" < difftest.edit.in 2> difftest.err)
+	fresh=$($EXE "$@" < difftest.edit.in 2> /dev/null)
+	grep -q resumed difftest.err && RESUMED=$((RESUMED + 1))
+	rm -rf $dir difftest.err
+	[ "$out" = "$fresh" ] && return 0
+	echo "resumed output differs from a fresh run"
+	diff <(echo "$fresh") <(echo "$out") | head -5
+	return 1
+}
+
+# Query TRACE with tracetool ARGS and compare with WANT
+query() {
+	local trace=$1 want=$2; shift 2
+	[ "$(./tracetool "$@" $trace)" = "$want" ] && return 0
+	echo "tracetool $* differs from the trace on stdout"
+	diff <(echo "$want") <(./tracetool "$@" $trace) | head -5
+	return 1
+}
+
+# Write the trace to a file, plain and compressed, and read it back
+trace_check() {
+	local trc plain lo node z rc=0
+	trc=$(mktemp)
+	plain=$($EXE "$@" < difftest.in 2> /dev/null | grep '^\[')
+	lo=$((i % 20)) node=$((1 + i % 2))
+	for z in "" -z; do
+		$EXE -T $trc $z "$@" < difftest.in > /dev/null 2>&1
+		query $trc "$plain" &&
+		query $trc "$(echo "$plain" | awk -v lo=$lo '$2 + 0 >= lo && $2 + 0 <= lo + 15')" -w $lo-$((lo + 15)) &&
+		query $trc "$(echo "$plain" | awk -v nd=$node 'substr($1, 2) + 0 == nd && $4 == 1')" -n $node -p 1 ||
+		{ rc=1; echo "with -T${z:+ -z}"; break; }
+	done
+	rm -f $trc
+	return $rc
+}
+
+# Run IN with the cache, its output must equal WANT and stderr report KIND
+cached() {
+	local in=$1 want=$2 kind=$3 out; shift 3
+	out=$($EXE --cache $CACHE "$@" < $in 2> difftest.err)
+	grep -q "| Cache | $kind" difftest.err && [ "$out" = "$want" ] && return 0
+	echo "expected a cache $kind matching a run without the cache"
+	cat difftest.err
+	diff <(echo "$want") <(echo "$out") | head -5
+	return 1
+}
+
+cache_check() {
+	local plain
+	plain=$($EXE "$@" < difftest.in 2> /dev/null)
+	cached difftest.in "$plain" miss "$@" && cached difftest.in "$plain" hit "$@" || return 1
+	edit $i < difftest.in > difftest.edit.in
+	cmp -s difftest.in difftest.edit.in && return 0
+	cached difftest.edit.in "$($EXE "$@" < difftest.edit.in 2> /dev/null)" miss "$@"
+}
+
+# The same plugin workload before and after its library changes
+plugin_cache_check() {
+	local plain
+	cp plugins/relay.so $CACHE/relay.so
+	sed "s#./plugins/relay.so#$CACHE/relay.so#" tests/test.14.in > difftest.in
+	plain=$($EXE < difftest.in 2> /dev/null)
+	cached difftest.in "$plain" miss && cached difftest.in "$plain" hit || return 1
+	echo >> $CACHE/relay.so
+	cached difftest.in "$plain" miss
+}
+
+if [ -n "$CACHE" ] && ! plugin_cache_check; then
+	echo "test 14 with a changed plugin library, kept as difftest.in"
+	exit 1
+fi
+
+RESUMED=0
+for i in $(seq $SEED $((SEED + COUNT - 1))); do
+	sched=${POLICIES[$((i % ${#POLICIES[@]}))]}
+	workload $i > difftest.in
+	if [ $CHECKPOINT = 1 ]; then
+		if ! resume_check --sched $sched -s $i "$@"; then
+			echo "workload $i, --sched $sched -s $i, kept as difftest.in and difftest.edit.in"
+			exit 1
+		fi
+		continue
+	fi
+	if [ -n "$CACHE" ]; then
+		if ! cache_check --sched $sched -s $i "$@"; then
+			echo "workload $i, --sched $sched -s $i, kept as difftest.in and difftest.edit.in"
+			exit 1
+		fi
+		continue
+	fi
+	if [ $TRACEFILE = 1 ]; then
+		if ! trace_check --sched $sched -s $i "$@"; then
+			echo "workload $i, --sched $sched -s $i, kept as difftest.in"
+			exit 1
+		fi
+		continue
+	fi
+	if ! out=$($EXE --diff --sched $sched -s $i "$@" < difftest.in); then
+		echo "workload $i, --sched $sched -s $i, kept as difftest.in"
+		echo "$out"
+		exit 1
+	fi
+done
+rm -f difftest.in difftest.edit.in difftest.err
+if [ $CHECKPOINT = 1 ]; then
+	echo "$COUNT workloads, $RESUMED resumed after an edit, all match a fresh run"
+elif [ -n "$CACHE" ]; then
+	echo "$COUNT workloads and a changed plugin, cache hits and misses match runs without it"
+elif [ $TRACEFILE = 1 ]; then
+	echo "$COUNT workloads, trace files and tracetool queries match the trace on stdout"
+else
+	echo "$COUNT workloads, fast and reference engines agree"
+fi
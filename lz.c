@@ -0,0 +1,119 @@
+#include <string.h>
+
+#include "lz.h"
+
+#define LZ_MIN_MATCH  4
+#define LZ_HASH_BITS  13
+#define LZ_MAX_OFFSET 65535
+#define LZ_TAIL       5      // last bytes always go out as literals
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static uint32_t lz_hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Length nibble overflow as a run of 255 bytes and a remainder
+static uint8_t *put_len(uint8_t *op, size_t len) {
+    while (len >= 255) { *op++ = 255; len -= 255; }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+// Emit literals [lit, lit + lit_len) and an optional match
+// Returns NULL when the sequence would overrun dst_end
+static uint8_t *put_seq(uint8_t *op, uint8_t *dst_end, const uint8_t *lit, size_t lit_len,
+                        size_t offset, size_t match_len) {
+    size_t need = 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1;
+    if ((size_t)(dst_end - op) < need) return NULL;
+
+    size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    uint8_t *token = op++;
+    *token = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+    if (lit_len >= 15) op = put_len(op, lit_len - 15);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (!match_len) return op;
+
+    *op++ = (uint8_t)(offset & 0xff);
+    *op++ = (uint8_t)(offset >> 8);
+    if (ml >= 15) op = put_len(op, ml - 15);
+    return op;
+}
+
+size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    uint32_t table[1u << LZ_HASH_BITS];   // position plus one, zero is empty
+    memset(table, 0, sizeof table);
+
+    uint8_t *op = dst, *end = dst + cap;
+    size_t ip = 0, anchor = 0;
+    size_t misses = 0;
+
+    if (n > LZ_TAIL + LZ_MIN_MATCH) {
+        size_t limit = n - LZ_TAIL;
+        while (ip + LZ_MIN_MATCH <= limit) {
+            uint32_t seq = read32(src + ip);
+            uint32_t h = lz_hash(seq);
+            size_t ref = table[h];
+            table[h] = (uint32_t)ip + 1;
+
+            if (ref && ip - (ref - 1) <= LZ_MAX_OFFSET && read32(src + ref - 1) == seq) {
+                ref--;
+                size_t len = LZ_MIN_MATCH;
+                while (ip + len < limit && src[ref + len] == src[ip + len]) len++;
+                op = put_seq(op, end, src + anchor, ip - anchor, ip - ref, len);
+                if (!op) return 0;
+                ip += len;
+                anchor = ip;
+                misses = 0;
+            } else {
+                // fast mode, skip ahead faster through data that does not match
+                ip += 1 + (misses++ >> 5);
+            }
+        }
+    }
+    op = put_seq(op, end, src + anchor, n - anchor, 0, 0);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+// Read a length that continues past its nibble
+static int get_len(const uint8_t **ip, const uint8_t *end, size_t *len) {
+    uint8_t b;
+    do {
+        if (*ip >= end) return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+int lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t raw_len) {
+    const uint8_t *ip = src, *end = src + n;
+    size_t out = 0;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && get_len(&ip, end, &lit) != 0) return -1;
+        if (lit > (size_t)(end - ip) || lit > raw_len - out) return -1;
+        memcpy(dst + out, ip, lit);
+        ip += lit;
+        out += lit;
+        if (ip == end) break;   // last sequence carries literals only
+
+        if (end - ip < 2) return -1;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t ml = token & 15;
+        if (ml == 15 && get_len(&ip, end, &ml) != 0) return -1;
+        ml += LZ_MIN_MATCH;
+        if (offset == 0 || offset > out || ml > raw_len - out) return -1;
+        // byte at a time, the match may overlap what it writes
+        for (size_t i = 0; i < ml; ++i, ++out) dst[out] = dst[out - offset];
+    }
+    return out == raw_len ? 0 : -1;
+}
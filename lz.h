@@ -0,0 +1,25 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Small LZ77 block codec in the LZ4 style, no external dependency
+ *
+ * A block is a run of sequences. Each sequence is a token byte holding
+ * literal length (high nibble) and match length minus four (low nibble),
+ * extra length bytes when a nibble is 15, the literals, then a two byte
+ * little endian match offset and extra match length bytes. The last
+ * sequence has literals only.
+ */
+
+// Worst case compressed size for n input bytes
+#define LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+// Compress n bytes into dst, returns compressed size or zero if it does not fit in cap
+size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap);
+
+// Decode exactly raw_len bytes into dst, returns zero on success, -1 on corrupt input
+int lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t raw_len);
+
+#endif
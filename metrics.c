@@ -0,0 +1,233 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+
+static MxBoard *board;
+static int listen_fd = -1;
+static char sock_path[108];
+static pthread_t server;
+static atomic_int stopping;
+
+static pthread_t reporter;
+static int reporting = 0;
+static double report_every;
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t report_wake = PTHREAD_COND_INITIALIZER;
+
+// Rate between scrapes, touched by the server thread only
+static uint64_t last_events;
+static double last_time;
+
+MxBoard *mx_board(int nodes) {
+    MxBoard *b = calloc(1, sizeof *b + sizeof(MxNode) * (size_t)(nodes + 1));
+    if (b) b->nodes = nodes;
+    return b;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Resident set size from /proc, zero where it cannot be read
+static long resident_bytes(void) {
+    long pages = 0, rss = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    if (fscanf(f, "%ld %ld", &pages, &rss) != 2) rss = 0;
+    fclose(f);
+    return rss * sysconf(_SC_PAGESIZE);
+}
+
+#define LOAD(x) atomic_load_explicit(&(x), memory_order_relaxed)
+
+// One per node gauge family
+static void node_family(FILE *o, const char *name, const char *help, size_t off) {
+    fprintf(o, "# HELP %s %s\n# TYPE %s gauge\n", name, help, name);
+    for (int n = 1; n <= board->nodes; ++n) {
+        _Atomic int *v = (_Atomic int *)((char *)&board->node[n] + off);
+        fprintf(o, "%s{node=\"%d\"} %d\n", name, n, atomic_load_explicit(v, memory_order_relaxed));
+    }
+}
+
+static void scalar(FILE *o, const char *name, const char *type, const char *help, double v) {
+    fprintf(o, "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name, help, name, type, name, v);
+}
+
+static void write_snapshot(FILE *o) {
+    uint64_t events = LOAD(board->events);
+    double t = now_sec();
+    double rate = t > last_time ? (events - last_events) / (t - last_time) : 0.0;
+    last_events = events;
+    last_time = t;
+
+    scalar(o, "prosim_running", "gauge", "One while the simulation runs", LOAD(board->running));
+    scalar(o, "prosim_events_total", "counter", "Process state changes simulated", (double)events);
+    scalar(o, "prosim_events_per_second", "gauge", "Events per wall second since the previous scrape", rate);
+    scalar(o, "prosim_procs_total", "gauge", "Processes in the workload", LOAD(board->procs_total));
+    scalar(o, "prosim_procs_finished", "gauge", "Processes finished", LOAD(board->procs_finished));
+    scalar(o, "prosim_replications", "gauge", "Replications requested", LOAD(board->replications));
+    scalar(o, "prosim_replications_done", "gauge", "Replications finished", LOAD(board->replications_done));
+    scalar(o, "prosim_resident_bytes", "gauge", "Resident memory of the simulator", (double)resident_bytes());
+    node_family(o, "prosim_node_clock", "Simulated time on the node", offsetof(MxNode, clock));
+    node_family(o, "prosim_node_ready", "Ready queue depth", offsetof(MxNode, ready));
+    node_family(o, "prosim_node_blocked", "Blocked processes", offsetof(MxNode, blocked));
+    node_family(o, "prosim_node_pending", "Pending releases", offsetof(MxNode, pending));
+    node_family(o, "prosim_node_finished", "Processes finished on the node", offsetof(MxNode, finished));
+}
+
+static void serve(int fd) {
+    // give an HTTP client a moment to send its request line
+    char req[512];
+    ssize_t n = 0;
+    struct pollfd p = { fd, POLLIN, 0 };
+    if (poll(&p, 1, 100) > 0) n = read(fd, req, sizeof req);
+
+    char *body = NULL;
+    size_t len = 0;
+    FILE *o = open_memstream(&body, &len);
+    if (!o) return;
+    write_snapshot(o);
+    fclose(o);
+
+    FILE *out = fdopen(dup(fd), "w");
+    if (out) {
+        if (n >= 3 && memcmp(req, "GET", 3) == 0)
+            fprintf(out, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: %zu\r\n\r\n", len);
+        fwrite(body, 1, len, out);
+        fclose(out);
+    }
+    free(body);
+}
+
+static void *server_main(void *arg) {
+    (void)arg;
+    while (!atomic_load(&stopping)) {
+        struct pollfd p = { listen_fd, POLLIN, 0 };
+        if (poll(&p, 1, 200) <= 0) continue;
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        serve(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+// Lowest and highest node clock on the board
+static void clock_span(int *lo, int *hi) {
+    *lo = *hi = 0;
+    for (int n = 1; n <= board->nodes; ++n) {
+        int c = LOAD(board->node[n].clock);
+        if (n == 1 || c < *lo) *lo = c;
+        if (c > *hi) *hi = c;
+    }
+}
+
+static void report_line(double start, uint64_t *prev_events, double *prev_t) {
+    double t = now_sec();
+    uint64_t events = LOAD(board->events);
+    double rate = t > *prev_t ? (events - *prev_events) / (t - *prev_t) : 0.0;
+    *prev_events = events;
+    *prev_t = t;
+
+    // ETA from the fraction of the work unit done so far, replications or procs
+    int reps = LOAD(board->replications);
+    int done = reps ? LOAD(board->replications_done) : LOAD(board->procs_finished);
+    int total = reps ? reps : LOAD(board->procs_total);
+    if (done > total) done = total;   // spawned procs finish too
+
+    char eta[32] = "unknown";
+    if (done > 0) snprintf(eta, sizeof eta, "%.0fs", (t - start) * (total - done) / done);
+
+    if (reps) {
+        fprintf(stderr, "prosim: %.0fs, replications %d/%d, %.0f events/s, ETA %s\n",
+                t - start, done, total, rate, eta);
+    } else {
+        int lo, hi;
+        clock_span(&lo, &hi);
+        fprintf(stderr, "prosim: %.0fs, clock %d..%d, finished %d/%d, %.0f events/s, ETA %s\n",
+                t - start, lo, hi, done, total, rate, eta);
+    }
+}
+
+static void *reporter_main(void *arg) {
+    (void)arg;
+    double start = now_sec(), prev_t = start;
+    uint64_t prev_events = 0;
+    pthread_mutex_lock(&report_lock);
+    while (!atomic_load(&stopping)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        long long ns = ts.tv_nsec + (long long)(report_every * 1e9);
+        ts.tv_sec += ns / 1000000000;
+        ts.tv_nsec = ns % 1000000000;
+        // mx_stop signals the condition so a long interval does not delay exit
+        if (pthread_cond_timedwait(&report_wake, &report_lock, &ts) == 0) continue;
+        if (atomic_load(&stopping)) break;
+        report_line(start, &prev_events, &prev_t);
+    }
+    pthread_mutex_unlock(&report_lock);
+    return NULL;
+}
+
+int mx_progress(MxBoard *b, double seconds) {
+    board = b;
+    report_every = seconds;
+    if (pthread_create(&reporter, NULL, reporter_main, NULL) != 0) return -1;
+    reporting = 1;
+    return 0;
+}
+
+int mx_start(MxBoard *b, const char *path) {
+    struct sockaddr_un a;
+    if (strlen(path) >= sizeof a.sun_path) return -1;
+    memset(&a, 0, sizeof a);
+    a.sun_family = AF_UNIX;
+    strcpy(a.sun_path, path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) return -1;
+    unlink(path);   // a stale socket from an earlier run
+    if (bind(listen_fd, (struct sockaddr *)&a, sizeof a) != 0 || listen(listen_fd, 8) != 0) {
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+    strcpy(sock_path, path);
+    board = b;
+    last_time = now_sec();
+    if (pthread_create(&server, NULL, server_main, NULL) != 0) {
+        close(listen_fd);
+        unlink(sock_path);
+        listen_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void mx_stop(void) {
+    atomic_store(&stopping, 1);
+    if (reporting) {
+        pthread_mutex_lock(&report_lock);
+        pthread_cond_signal(&report_wake);
+        pthread_mutex_unlock(&report_lock);
+        pthread_join(reporter, NULL);
+        reporting = 0;
+    }
+    if (listen_fd < 0) return;
+    pthread_join(server, NULL);
+    close(listen_fd);
+    unlink(sock_path);
+    listen_fd = -1;
+}
@@ -0,0 +1,46 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* Live metrics over a Unix domain socket
+ *
+ * The simulation stores current values into an MxBoard with relaxed
+ * atomic stores and never waits on the server. A server thread accepts
+ * connections on the socket and answers each with one snapshot in the
+ * Prometheus text exposition format, then closes it. A client that sends
+ * an HTTP request first, e.g. curl --unix-socket, gets an HTTP reply.
+ *
+ * The same board drives an optional progress reporter, a thread that
+ * wakes every few wall seconds and prints one line to stderr.
+ */
+
+typedef struct {
+    _Atomic int clock;
+    _Atomic int ready, blocked, pending;
+    _Atomic int finished;
+} MxNode;
+
+typedef struct {
+    int nodes;
+    _Atomic uint64_t events;        // state changes so far
+    _Atomic int procs_total, procs_finished;
+    _Atomic int replications, replications_done;
+    _Atomic int running;            // one while the simulation runs
+    MxNode node[];                  // one based, nodes + 1 entries
+} MxBoard;
+
+// Board for nodes nodes, all zero
+MxBoard *mx_board(int nodes);
+
+// Bind path and start serving b, returns zero on success
+int mx_start(MxBoard *b, const char *path);
+
+// Print progress of b to stderr every seconds, returns zero on success
+int mx_progress(MxBoard *b, double seconds);
+
+// Stop the server and the reporter, remove the socket and free nothing else
+void mx_stop(void);
+
+#endif
@@ -0,0 +1,76 @@
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+static const struct { uint32_t type; uint64_t config; } pc_events[PC_NS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+static int perf_open(uint32_t type, uint64_t config, int group) {
+    struct perf_event_attr a;
+    memset(&a, 0, sizeof a);
+    a.size = sizeof a;
+    a.type = type;
+    a.config = config;
+    a.disabled = (group == -1);      // leader starts the whole group
+    a.exclude_kernel = 1;
+    a.exclude_hv = 1;
+    a.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &a, 0, -1, group, 0);
+}
+
+int pc_open(PcSet *s, const char **why) {
+    int leader = -1;
+    s->open = 0;
+    *why = NULL;
+    for (int k = 0; k < PC_NS; ++k) {
+        s->fd[k] = perf_open(pc_events[k].type, pc_events[k].config, leader);
+        if (s->fd[k] < 0) {
+            if (!*why) *why = errno == ENOENT ? "event not supported"
+                            : errno == EACCES || errno == EPERM ? "not permitted"
+                            : errno == ENOSYS ? "no perf_event_open" : strerror(errno);
+            continue;
+        }
+        if (leader < 0) leader = s->fd[k];
+        s->slot[k] = s->open++;
+    }
+    if (leader >= 0) {
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    return s->open;
+}
+
+void pc_read(const PcSet *s, uint64_t *v) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    v[PC_NS] = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+
+    uint64_t buf[1 + PC_NS];
+    int leader = -1;
+    for (int k = 0; k < PC_NS && leader < 0; ++k) if (s->fd[k] >= 0) leader = s->fd[k];
+    int ok = leader >= 0 && read(leader, buf, sizeof buf) >= (ssize_t)sizeof(uint64_t);
+    for (int k = 0; k < PC_NS; ++k)
+        v[k] = (ok && s->fd[k] >= 0 && (uint64_t)s->slot[k] < buf[0]) ? buf[1 + s->slot[k]] : 0;
+}
+
+int pc_have(const PcSet *s, int k) {
+    return k == PC_NS || s->fd[k] >= 0;
+}
+
+void pc_close(PcSet *s) {
+    for (int k = 0; k < PC_NS; ++k) {
+        if (s->fd[k] >= 0) close(s->fd[k]);
+        s->fd[k] = -1;
+    }
+    s->open = 0;
+}
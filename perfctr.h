@@ -0,0 +1,35 @@
+#ifndef PERFCTR_H
+#define PERFCTR_H
+
+#include <stdint.h>
+
+/* Hardware event counters for the calling thread, via perf_event_open
+ *
+ * Cycles, instructions, cache misses and branch misses are opened as one
+ * group so a single read returns all of them. Counting is user space only,
+ * which perf_event_paranoid 2 still allows. Where the kernel, a container
+ * or the cpu refuses a counter it reads as zero and pc_have says so; wall
+ * time is always measured.
+ */
+
+enum { PC_CYCLES, PC_INSTR, PC_CACHE_MISS, PC_BRANCH_MISS, PC_NS, PC_COUNT };
+
+typedef struct {
+    int fd[PC_NS];      // -1 for a counter that did not open
+    int slot[PC_NS];    // position of each open counter in a group read
+    int open;           // counters in the group
+} PcSet;
+
+// Open the counters for this thread, returns how many hardware counters work
+// Sets *why to a short reason when none do
+int pc_open(PcSet *s, const char **why);
+
+// Current running totals, PC_NS is a monotonic clock
+void pc_read(const PcSet *s, uint64_t *v);
+
+// Is counter k live
+int pc_have(const PcSet *s, int k);
+
+void pc_close(PcSet *s);
+
+#endif
@@ -0,0 +1,121 @@
+#!/bin/bash
+
+# USAGE:
+# Write the generated workloads to DIR, VARIANT 0 for training and 1 for timing
+#   ./pgo.sh gen DIR [VARIANT]
+# Run EXE over every workload in DIR the way training does
+#   ./pgo.sh train EXE DIR
+# Time each EXE over every workload in DIR, speedup against the first
+#   ./pgo.sh compare DIR EXE...
+#
+# Workloads stay under MAX_PROCS procs and MAX_OPS ops per expanded program.
+# Replications make a run long enough to time, one thread keeps it steady.
+
+REPS=${REPS:-200}
+
+# doop NODES LOOPS SHIFT: three CPU bound procs per node, fixed and drawn ticks
+doop() {
+	local N=$1 L=$2 S=$3
+	echo "$((N*3)) $N 4"
+	for n in $(seq 1 $N); do
+		for k in 1 2 3; do
+			echo "D$n.$k 1 $k $n"
+			echo "LOOP $L"
+			echo "DOOP $(( (n + k + S) % 7 + 1 ))"
+			echo "DOOP U(1,$(( k + 4 )))"
+			echo "END"; echo "HALT"; echo
+		done
+	done
+}
+
+# block NODES LOOPS SHIFT: procs that mostly wait on timed blocks
+block() {
+	local N=$1 L=$2 S=$3
+	echo "$((N*3)) $N 3"
+	for n in $(seq 1 $N); do
+		for k in 1 2 3; do
+			echo "B$n.$k 1 1 $n"
+			echo "LOOP $L"
+			echo "DOOP 1"
+			echo "BLOCK $(( (n * k + S) % 9 + 2 ))"
+			echo "BLOCK E(3)"
+			echo "END"; echo "HALT"; echo
+		done
+	done
+}
+
+# msg NODES LOOPS SHIFT: a send ring between nodes and a fan-in to node one
+msg() {
+	local N=$1 L=$2 S=$3
+	echo "$((N*3)) $N 3"
+	for n in $(seq 1 $N); do
+		local nx=$(( n % N + 1 )) pv=$(( (n + N - 2) % N + 1 ))
+		echo "M$n.1 1 1 $n"
+		echo "LOOP $L"; echo "DOOP $(( (n + S) % 3 + 1 ))"; echo "SEND ${nx}02"; echo "END"
+		echo "HALT"; echo
+		echo "M$n.2 1 1 $n"
+		echo "LOOP $L"; echo "RECV ${pv}01"; echo "DOOP 1"; echo "END"
+		if [ $n != 1 ]; then echo "SEND 103"; fi
+		echo "HALT"; echo
+		echo "M$n.3 1 1 $n"
+		if [ $n = 1 ]; then
+			for m in $(seq 2 $N); do echo "RECV ${m}02"; done
+		else
+			echo "LOOP $L"; echo "DOOP 1"; echo "BLOCK 1"; echo "END"
+		fi
+		echo "HALT"; echo
+	done
+}
+
+gen() {
+	local dir=$1 v=${2:-0}
+	mkdir -p "$dir"
+	doop  $(( 30 - v * 5 )) $(( 60 + v * 10 )) $v > "$dir/doop.in"
+	block $(( 30 - v * 5 )) $(( 50 + v * 10 )) $v > "$dir/block.in"
+	msg   $(( 30 - v * 5 )) $(( 80 + v * 20 )) $v > "$dir/msg.in"
+}
+
+train() {
+	local exe=$1 dir=$2
+	for w in "$dir"/*.in; do
+		for s in rr fair edf; do
+			"$exe" -R $(( REPS / 4 )) -j 1 --sched $s < "$w" > /dev/null || exit 1
+		done
+	done
+}
+
+# Best of three wall times in seconds
+best() {
+	local exe=$1 w=$2 b=
+	for i in 1 2 3; do
+		local t0=$(date +%s%N)
+		"$exe" -R $REPS -j 1 < "$w" > /dev/null || exit 1
+		local t=$(( $(date +%s%N) - t0 ))
+		if [ -z "$b" ] || [ $t -lt $b ]; then b=$t; fi
+	done
+	echo $b
+}
+
+compare() {
+	local dir=$1; shift
+	printf "| %-8s |" workload
+	for e in "$@"; do printf " %-18s |" "$(basename "$e")"; done
+	echo
+	for w in "$dir"/*.in; do
+		printf "| %-8s |" "$(basename "$w" .in)"
+		local base=
+		for e in "$@"; do
+			local t=$(best "$e" "$w")
+			[ -z "$base" ] && base=$t
+			awk -v t=$t -v b=$base 'BEGIN { printf " %7.3fs %6.2fx   |", t / 1e9, b / t }'
+		done
+		echo
+	done
+}
+
+case $1 in
+gen)     gen "$2" "$3" ;;
+train)   train "$2" "$3" ;;
+compare) shift; compare "$@" ;;
+*)       sed -n '3,12p' "$0"; exit 2 ;;
+esac
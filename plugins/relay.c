@@ -0,0 +1,62 @@
+#include <stdlib.h>
+
+#include "../prosim_plugin.h"
+
+/* Example behaviors for PLUGIN lines, build with make plugins
+ *
+ * relay:SRC/DST1,DST2,.../N
+ *   N times receive from SRC, work for a tick per message so far, then
+ *   send to the next destination in turn. Ends with HALT.
+ *
+ * fanin:SRC1,SRC2,.../DST
+ *   Receive once from each source in order, then send the count of
+ *   messages as DOOP work and forward one message to DST.
+ */
+
+#define MAX_DST 8
+
+// Parse "a,b,c" into out, returns count
+static int parse_list(const char *s, char **end, long *out) {
+    int n = 0;
+    while (n < MAX_DST) {
+        out[n++] = strtol(s, end, 10);
+        if (**end != ',') break;
+        s = *end + 1;
+    }
+    return n;
+}
+
+int relay(ps_ctx *ctx, ps_op *op) {
+    // v[0] src, v[1] count, v[2] rounds, v[3] round, v[4] next dst, v[8..] dst list
+    PS_BEGIN(ctx);
+    {
+        char *end;
+        ctx->v[0] = strtol(ctx->arg, &end, 10);
+        if (*end == '/') ctx->v[1] = parse_list(end + 1, &end, &ctx->v[8]);
+        ctx->v[2] = (*end == '/') ? strtol(end + 1, NULL, 10) : 1;
+    }
+    for (ctx->v[3] = 0; ctx->v[3] < ctx->v[2]; ctx->v[3]++) {
+        PS_YIELD(ctx, op, PS_RECV, (int)ctx->v[0]);
+        PS_YIELD(ctx, op, PS_DOOP, ctx->recvs);
+        if (ctx->v[1] > 0) {
+            PS_YIELD(ctx, op, PS_SEND, (int)ctx->v[8 + ctx->v[4]]);
+            ctx->v[4] = (ctx->v[4] + 1) % ctx->v[1];
+        }
+    }
+    PS_END(ctx, op);
+}
+
+int fanin(ps_ctx *ctx, ps_op *op) {
+    // v[0] source count, v[1] dst, v[2] index, v[8..] sources
+    PS_BEGIN(ctx);
+    {
+        char *end;
+        ctx->v[0] = parse_list(ctx->arg, &end, &ctx->v[8]);
+        ctx->v[1] = (*end == '/') ? strtol(end + 1, NULL, 10) : 0;
+    }
+    for (ctx->v[2] = 0; ctx->v[2] < ctx->v[0]; ctx->v[2]++)
+        PS_YIELD(ctx, op, PS_RECV, (int)ctx->v[8 + ctx->v[2]]);
+    PS_YIELD(ctx, op, PS_DOOP, ctx->recvs);
+    if (ctx->v[1] > 0) PS_YIELD(ctx, op, PS_SEND, (int)ctx->v[1]);
+    PS_END(ctx, op);
+}
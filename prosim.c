@@ -1,21 +1,51 @@
+#define _GNU_SOURCE   // dladdr, to name a plugin in checkpoint and cache keys
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <math.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <sched.h>
+#include <sys/wait.h>
+
+#include "tracefile.h"
+#include "perfctr.h"
+#include "metrics.h"
+#include "shmring.h"
+#include "store.h"
+#include "prosim_plugin.h"
 
 #define MAX_PROCS  100
 #define MAX_NODES  100
 #define MAX_OPS    256
+#define MAX_TOK    64
 
 // Process life cycle flags used by run loop and logs
-typedef enum { NEW, READY, RUNNING, BLOCKED, FINISHED } State;
+typedef enum { NEW, READY, RUNNING, BLOCKED, FINISHED, CRASHED } State;
 // Operation kinds read from input and executed by runner
-typedef enum { DOOP, BLOCK, HALT, SEND, RECV, INVALID } OpType;
+typedef enum { DOOP, BLOCK, HALT, SEND, RECV, SPAWN, EXIT, DEADLINE, INVALID } OpType;
+// Trace line kinds, also the unit of the state filter
+typedef enum { EV_NEW, EV_READY, EV_RUNNING, EV_BLOCKED, EV_BLOCKED_SEND, EV_BLOCKED_RECV,
+               EV_FINISHED, EV_CRASHED, EV_COUNT } Event;
+// Operand kinds, fixed or drawn from a distribution at reset
+typedef enum { DIST_FIXED, DIST_UNIFORM, DIST_EXP, DIST_LOGNORMAL } Dist;
 
 
 // One instruction in program stream
 typedef struct {
     OpType type;
     int a;              // DOOP or BLOCK ticks, SEND or RECV address as node times one hundred plus pid
+                        // SPAWN target node, DEADLINE ticks after the point it is reached
+    int b;              // SPAWN template index into proto_procs
+                        // SEND or RECV timeout ticks, zero waits for the partner forever
+    Dist dist;          // how a is produced for DOOP or BLOCK
+    double d1, d2;      // U lo hi, E mean, L mu sigma
 } Operation;
 
 // Control block for one process
@@ -24,7 +54,9 @@ typedef struct Process {
     char name[32];
     int size, priority, node;   // node ids start at one
     int pid_global;             // one based id across all procs
+    int proto;                  // index in proto_procs it was copied from
     int node_pid;               // one based id within node
+    int home;                   // address it answers to, where it started even after a move
 
     // program
     Operation ops[MAX_OPS];
@@ -33,9 +65,36 @@ typedef struct Process {
     // dynamic
     State state;
     int run_time, block_time, wait_time, finish_time;
-    int unblock_time;   // absolute time on this node for a timed BLOCK
+    int unblock_time;   // absolute time on this node for a timed BLOCK or a SEND or RECV timeout
 
     int sends, recvs;
+    int timeouts;       // SEND or RECV given up when its timeout ran out
+    int lost;           // run ticks thrown away by node crashes
+
+    int deadline;                      // absolute deadline of the current segment, zero if none
+    int deadlines, missed, lateness;   // segments closed, late ones, total ticks late
+    unsigned rq_seq;                   // ready queue arrival order, breaks key ties
+    long long vruntime;                // fair policy: run ticks scaled by FAIR_UNIT / weight
+                                       // stride policy: the same sum is the pass
+    long long pass_left;               // stride: pass ahead of the node when p blocked
+    int away;                          // stride: blocked since its last turn in the queue
+    int rq_pos;                        // lottery: index in ready
+    int gang;                          // communication group from the programs, zero if none
+    int rdv_since;                     // clock when the current SEND or RECV blocked
+    int rdv_wait;                      // ticks spent blocked on SEND or RECV until matched
+    int rdv_released;                  // set by a match until the proc is next queued
+    int chain_origin;                  // when the data it last received left its source
+    int chain_sink;                    // program receives but never sends, ends a chain
+    int run_contended;                 // run ticks before the first finish on this node
+
+    uint64_t rng;       // per process stream for distribution operands
+
+    // native behavior that supplies ops once the listed ones run out
+    ps_behavior behavior;
+    ps_ctx ctx;
+
+    struct Process *next_free;  // link while parked in a node slab free list
+    struct Process *glob_prev, *glob_next;  // blocked list links, fast engine only
 
     // rendezvous wish kept while BLOCKED on SEND or RECV
     // sender sets want_dst_addr
@@ -49,8 +108,22 @@ typedef struct Pending {
     Process *p;
     int due_time;
     int is_finish;  // one means finish at due_time, zero means go READY at due_time
+                    // two means a spawned proc arrives NEW then READY at due_time
 } Pending;
 
+// Chunk of process records for spawned procs, never freed until reset
+#define SLAB_PROCS 32
+typedef struct Slab {
+    struct Slab *next;
+    Process recs[SLAB_PROCS];
+} Slab;
+
+// Node local pids stay below one hundred so addresses remain node * 100 + pid
+#define MAX_NODE_PID 99
+
+// Lottery Fenwick tree slots, a power of two above MAX_NODE_PID
+#define LOT_SLOTS 128
+
 // One compute node with own clock and queues
 typedef struct Node {
     int node_id;
@@ -61,22 +134,377 @@ typedef struct Node {
     int proc_count;
 
     Process *ready[MAX_PROCS];   int ready_count;
+    Process *comm[MAX_PROCS];    int comm_count;    // released partners under --comm-boost
+    int comm_streak;             // dispatches in a row taken from comm
     Process *blocked[MAX_PROCS]; int blocked_count;
 
     Pending pend[MAX_PROCS * 2]; int pend_count;
+
+    // totals for the machine readable summary
+    int busy_time;      // ticks spent running a process
+    int dispatches;     // times a process was switched in
+    int messages;       // completed SEND or RECV by local procs
+
+    int next_sample;    // next sampler boundary on this node clock
+
+    // spawned procs, records recycled through free_procs on EXIT
+    Slab *slabs;
+    Process *free_procs;
+    uint64_t pid_used[2];   // bit per node pid in use
+    int spawned, exited, spawn_failed;
+    int exited_run, exited_block, exited_wait;
+    int last_finish;        // latest finish of any proc here, exited ones included
+    int exited_missed;      // deadline misses of procs that EXITed
+    int timeouts;           // SEND or RECV timeouts of local procs, exited ones included
+
+    unsigned rq_seq;        // next ready queue arrival number
+    long long min_vruntime; // fair and stride: vruntime of the latest dispatch, never decreases
+    int tickets[LOT_SLOTS + 1];           // lottery: Fenwick tree of ready tickets by pid
+    Process *lot_proc[LOT_SLOTS + 1];     // lottery: ready proc by pid
+    uint64_t lot_rng;
+    int finished_count;     // local procs finished, the first ends the contended window
+    int weight_sum, contended_sum;   // filled for the summary by share_totals
+    long long rdv_wait;     // rendezvous wait of local procs, exited ones included
+    int rendezvous;         // local parties released by a match
+    int chain_msgs;         // messages delivered to local chain sinks
+    long long chain_sum;    // and their end to end latency
+    int chain_max;
+
+    // --fault: the node is down while down_from <= clock < down_until
+    int faults_done;        // entries of its schedule applied so far
+    int down_from, down_until;
+    int crashes;
+    int crash_procs;        // procs a crash took, once per crash
+    int restarts;           // of those, procs started over here or elsewhere
+    int lost;               // their run ticks, gone with the crash
+    int rdv_failed;         // local SEND or RECV failed because the partner crashed
 } Node;
 
 /* --------- globals --------- */
-// Shared store for all procs and nodes
+// Workload as parsed, copied into the live state on every reset
 static int total_procs, quantum, num_nodes;
-static Process all_procs[MAX_PROCS];
-static Node nodes[MAX_NODES + 1]; // nodes are one based
+static Process proto_procs[MAX_PROCS];
+
+// Ready queue policies
+typedef enum { POLICY_RR, POLICY_EDF, POLICY_FAIR, POLICY_GANG, POLICY_STRIDE, POLICY_LOTTERY } Policy;
+static const char *policy_name[] = { "rr", "edf", "fair", "gang", "stride", "lottery" };
+
+// vruntime advance of one tick at weight one
+#define FAIR_UNIT 1024
+
+// Run options, read only once the simulation starts
+static uint64_t opt_seed = 1;
+static int opt_replications = 0;  // zero means one traced run
+static int opt_threads = 0;       // zero means one per online cpu
+static Policy opt_sched = POLICY_RR;
+static int opt_comm_boost = 0;    // dispatches in a row for released partners, zero is off
+static int opt_perf = 0;          // count hardware events per engine phase
+static const char *opt_metrics = NULL;   // Unix socket path for live metrics
+static double opt_progress = 0;          // wall seconds between progress lines, zero is off
+static int opt_memory = 0;               // memory breakdown on stderr at exit
+static int opt_dry_run = 0;              // parse and project memory, do not simulate
+static int opt_reference = 0;            // match by scanning the blocked array, the original engine
+static int opt_diff = 0;                 // run both engines and compare their output
+static int opt_partitions = 0;           // worker processes that split the nodes, zero runs in one
+static int opt_part_stats = 0;           // per partition cpu against simulated work, on stderr
+static const char *opt_checkpoint = NULL;  // directory of checkpoints to resume from and add to
+static int opt_checkpoint_every = 1000;    // ticks between checkpoints
+static const char *opt_cache = NULL;       // directory of stored outputs, NULL is off
+static long long opt_cache_size = 64;      // MiB the cache may hold
+static MxBoard *board;                   // what the metrics server reads, NULL when off
+
+// Node crashes from --fault, sorted by node then time, seq counts within the node
+#define MAX_FAULTS 64
+typedef struct { int node, at, until, seq; } Fault;   // until is 0x3fffffff when it stays down
+typedef enum { FAULT_WAIT, FAULT_FAIL, FAULT_MIGRATE } FaultPolicy;
+static const char *fault_policy_name[] = { "wait", "fail", "migrate" };
+static Fault faults[MAX_FAULTS];
+static int fault_count;
+static FaultPolicy opt_fault_policy = FAULT_WAIT;
+
+// Trace filter compiled from --trace-filter, every set full means trace all
+// Masks are one bit per node, pid and event kind, time is an inclusive window
+#define PID_BITS 128
+static uint64_t trace_nodes[(MAX_NODES + 64) / 64];
+static uint64_t trace_pids[PID_BITS / 64];
+static uint32_t trace_events;
+static int trace_t_lo, trace_t_hi;
+
+// Indexed trace file, NULL means trace lines go to stdout
+static const char *opt_trace_file = NULL;
+static int opt_trace_compress = 0;
+static TfWriter *trace_file = NULL;
+
+// Final summary layout and destination
+typedef enum { SUMMARY_TEXT, SUMMARY_CSV, SUMMARY_JSON } SummaryFormat;
+static SummaryFormat opt_summary = SUMMARY_TEXT;
+static const char *opt_summary_out = NULL;   // NULL means stdout
+
+// Time series sampler, zero interval means off
+typedef enum { SAMPLE_CSV, SAMPLE_BIN } SampleFormat;
+static int opt_sample_interval = 0;
+static const char *opt_sample_out = NULL;
+static SampleFormat opt_sample_format = SAMPLE_CSV;
+
+// Live store for all procs and nodes, one copy per simulating thread
+static __thread Process *all_procs;   // MAX_PROCS entries
+static __thread Node *nodes;          // MAX_NODES + 1 entries, nodes are one based
 
 // List of SEND or RECV blocked procs for cross node match search
-static Process *glob_blocked[MAX_PROCS * MAX_NODES];
-static int glob_blocked_count = 0;
+static __thread Process **glob_blocked;
+static __thread int glob_blocked_count = 0;
+
+// Fast engine: the same procs linked in arrival order and indexed by address
+#define ADDR_SLOTS ((MAX_NODES + 1) * 100)
+static __thread Process *glob_head, *glob_tail;
+static __thread Process **glob_at;    // ADDR_SLOTS entries
+
+// Seed of the current run and count of procs spawned in it
+static __thread uint64_t sim_seed;
+static __thread int spawn_seq;
+static __thread uint64_t sim_events;   // state changes, traced or not
+static __thread int sim_finished;
+
+// Partition mode: a worker process sends what crosses nodes to the coordinator
+// instead of doing it, tagged with the engine step it came from
+typedef enum { MSG_STATE, MSG_RDV, MSG_SPAWN, MSG_RELEASE, MSG_GIVEUP } MsgKind;
+static ShmRing *part_out;   // set in workers only
+static int part_phase;
+
+// Records come from one shared mapping made before fork, slabs from a pool in it
+static char *part_shm;
+static size_t part_shm_bytes;
+static Slab *slab_pool;
+#define SLABS_PER_NODE ((MAX_NODE_PID + SLAB_PROCS - 1) / SLAB_PROCS)
+static __thread int board_owner;       // this thread's run is the one on the board
+
+// Template names seen in SPAWN ops, resolved to proto_procs after parsing
+static char spawn_names[MAX_PROCS][32];
+static int spawn_name_count = 0;
+static int workload_has_deadlines = 0;   // adds deadline columns to the text summary
+static int workload_has_timeouts = 0;    // adds timeout columns to the text summary
+static int gang_count = 0;               // groups of two or more procs that talk
+
+/* --------- engine phase counters --------- */
+typedef enum { PH_FLUSH, PH_EXPIRE, PH_RUN, PH_MATCH, PH_OTHER, PH_COUNT } Phase;
+static const char *phase_name[PH_COUNT] = { "flush", "expire", "run", "match", "other" };
+
+// Counter totals of one sim thread, split by the phase they were spent in
+typedef struct PerfThread {
+    PcSet pc;
+    unsigned hw;                     // bit k set when counter k opened
+    Phase phase;                     // phase running since mark
+    uint64_t mark[PC_COUNT];
+    uint64_t sum[PH_COUNT][PC_COUNT];
+    int id;
+    struct PerfThread *next;
+} PerfThread;
+
+static __thread PerfThread *perf;    // NULL unless --perf
+static PerfThread *perf_done;        // threads that finished, reported at exit
+static int perf_next_id = 0;
+static const char *perf_why;         // why hardware counters are missing
+static pthread_mutex_t perf_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Charge counters since the last switch to the current phase, then run ph
+// Returns the phase that was running so a nested one can hand back
+static Phase perf_enter(Phase ph) {
+    if (!perf) return ph;
+    uint64_t v[PC_COUNT];
+    pc_read(&perf->pc, v);
+    for (int k = 0; k < PC_COUNT; ++k) perf->sum[perf->phase][k] += v[k] - perf->mark[k];
+    memcpy(perf->mark, v, sizeof v);
+    Phase was = perf->phase;
+    perf->phase = ph;
+    return was;
+}
+
+static void perf_begin(void) {
+    if (!opt_perf) return;
+    perf = calloc(1, sizeof *perf);
+    if (!perf) { fprintf(stderr, "prosim: out of memory\n"); exit(1); }
+    const char *why;
+    pc_open(&perf->pc, &why);
+    for (int k = 0; k < PC_NS; ++k) if (pc_have(&perf->pc, k)) perf->hw |= 1u << k;
+    pthread_mutex_lock(&perf_lock);
+    perf->id = perf_next_id++;
+    if (why && !perf_why) perf_why = why;
+    pthread_mutex_unlock(&perf_lock);
+    perf->phase = PH_OTHER;
+    pc_read(&perf->pc, perf->mark);
+}
+
+static void perf_end(void) {
+    if (!perf) return;
+    perf_enter(PH_OTHER);
+    pc_close(&perf->pc);
+    pthread_mutex_lock(&perf_lock);
+    perf->next = perf_done;
+    perf_done = perf;
+    pthread_mutex_unlock(&perf_lock);
+    perf = NULL;
+}
+
+// One stderr line for a phase total, hardware columns only where counted
+static void perf_line(const char *who, Phase ph, const uint64_t *v, unsigned hw) {
+    static const char *label[PC_NS] = { "Cycles", "Instructions", "Cache misses", "Branch misses" };
+    fprintf(stderr, "| Perf | %s | %-6s | %.3f ms", who, phase_name[ph], v[PC_NS] / 1e6);
+    for (int k = 0; k < PC_NS; ++k)
+        if (hw & (1u << k)) fprintf(stderr, ", %s %llu", label[k], (unsigned long long)v[k]);
+    if ((hw & 3u) == 3u)
+        fprintf(stderr, ", IPC %.2f", v[PC_CYCLES] ? (double)v[PC_INSTR] / v[PC_CYCLES] : 0.0);
+    fprintf(stderr, "\n");
+}
+
+// Per thread rows when there are several, then totals per phase
+static void perf_report(void) {
+    if (!opt_perf) return;
+    uint64_t total[PH_COUNT][PC_COUNT] = { { 0 } };
+    unsigned hw = (1u << PC_NS) - 1;
+    int threads = 0;
+    for (PerfThread *t = perf_done; t; t = t->next) {
+        hw &= t->hw;
+        threads++;
+    }
+    if (hw != (1u << PC_NS) - 1)
+        fprintf(stderr, "| Perf | %shardware counters unavailable (%s)%s\n", hw ? "some " : "",
+                perf_why ? perf_why : "not opened", hw ? "" : ", wall time only");
+    for (int id = 0; id < perf_next_id; ++id) {
+        for (PerfThread *t = perf_done; t; t = t->next) {
+            if (t->id != id) continue;
+            char who[32];
+            snprintf(who, sizeof who, "thread %d", id);
+            for (int ph = 0; ph < PH_COUNT; ++ph) {
+                for (int k = 0; k < PC_COUNT; ++k) total[ph][k] += t->sum[ph][k];
+                if (threads > 1) perf_line(who, ph, t->sum[ph], hw);
+            }
+        }
+    }
+    for (int ph = 0; ph < PH_COUNT; ++ph) perf_line("total", ph, total[ph], hw);
+    while (perf_done) {
+        PerfThread *t = perf_done;
+        perf_done = t->next;
+        free(t);
+    }
+}
+
+/* --------- memory accounting --------- */
+typedef enum { MEM_PROCS, MEM_PROGRAMS, MEM_QUEUES, MEM_NODES, MEM_RENDEZVOUS, MEM_OUTPUT, MEM_COUNT } MemKind;
+static const char *mem_name[MEM_COUNT] = { "procs", "programs", "queues", "nodes", "rendezvous", "output" };
+
+// Parts of the fixed records that belong to other kinds
+#define PROGRAM_BYTES    sizeof(((Process *)0)->ops)
+#define NODE_QUEUE_BYTES (sizeof(((Node *)0)->ready) + sizeof(((Node *)0)->comm) \
+                          + sizeof(((Node *)0)->blocked) + sizeof(((Node *)0)->pend) \
+                          + sizeof(((Node *)0)->tickets) + sizeof(((Node *)0)->lot_proc))
+
+// Bytes in use by kind across all threads, and the split when the total peaked
+static long long mem_now[MEM_COUNT], mem_at_peak[MEM_COUNT], mem_peak;
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Add b[k] bytes of every kind, times sign, allocation sites are rare so a lock is fine
+static void mem_add_all(const long long *b, int sign) {
+    pthread_mutex_lock(&mem_lock);
+    long long total = 0;
+    for (int k = 0; k < MEM_COUNT; ++k) total += (mem_now[k] += sign * b[k]);
+    if (total > mem_peak) {
+        mem_peak = total;
+        memcpy(mem_at_peak, mem_now, sizeof mem_now);
+    }
+    pthread_mutex_unlock(&mem_lock);
+}
+
+static void mem_add(MemKind k, long long bytes) {
+    long long b[MEM_COUNT] = { 0 };
+    b[k] = bytes;
+    mem_add_all(b, 1);
+}
+
+// n process records, split into program and the rest
+static void mem_procs(long long *b, long long n) {
+    b[MEM_PROCS] += n * (long long)(sizeof(Process) - PROGRAM_BYTES);
+    b[MEM_PROGRAMS] += n * (long long)PROGRAM_BYTES;
+}
+
+// One thread's sim state as sim_alloc allocates it
+static void mem_sim_state(long long *b) {
+    mem_procs(b, MAX_PROCS);
+    b[MEM_QUEUES] += (MAX_NODES + 1) * (long long)NODE_QUEUE_BYTES;
+    b[MEM_NODES] += (MAX_NODES + 1) * (long long)(sizeof(Node) - NODE_QUEUE_BYTES);
+    b[MEM_RENDEZVOUS] += (MAX_PROCS * MAX_NODES + ADDR_SLOTS) * (long long)sizeof(Process *);
+}
+
+// Kind split of b and its total in KiB, one stderr or stdout line
+static void mem_line(FILE *f, const char *what, const long long *b) {
+    long long total = 0;
+    for (int k = 0; k < MEM_COUNT; ++k) total += b[k];
+    fprintf(f, "| Memory | %s %.1f KiB |", what, total / 1024.0);
+    for (int k = 0; k < MEM_COUNT; ++k) fprintf(f, "%s %s %.1f", k ? "," : "", mem_name[k], b[k] / 1024.0);
+    fprintf(f, " KiB\n");
+}
+
+// Breakdown now and at the peak, on stderr
+static void mem_report(const char *when) {
+    if (!opt_memory) return;
+    pthread_mutex_lock(&mem_lock);
+    mem_line(stderr, when, mem_now);
+    mem_line(stderr, "peak", mem_at_peak);
+    pthread_mutex_unlock(&mem_lock);
+}
 
 /* --------- helpers --------- */
+// Growable byte buffer so structured output leaves in one write
+typedef struct { char *p; size_t len, cap; } Buf;
+
+static void buf_reserve(Buf *b, size_t extra) {
+    if (b->len + extra + 1 <= b->cap) return;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + extra + 1) cap *= 2;
+    char *np = realloc(b->p, cap);
+    if (!np) { fprintf(stderr, "prosim: out of memory\n"); exit(1); }
+    mem_add(MEM_OUTPUT, (long long)(cap - b->cap));
+    b->p = np; b->cap = cap;
+}
+
+static void buf_printf(Buf *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void buf_printf(Buf *b, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    buf_reserve(b, (size_t)n);
+    va_start(ap, fmt);
+    vsnprintf(b->p + b->len, b->cap - b->len, fmt, ap);
+    va_end(ap);
+    b->len += (size_t)n;
+}
+
+static void buf_add(Buf *b, const void *p, size_t n) {
+    buf_reserve(b, n);
+    memcpy(b->p + b->len, p, n);
+    b->len += n;
+}
+
+// Trace lines since the last checkpoint, kept only while checkpoints are written
+static Buf ckpt_seg;
+static int ckpt_next;   // max clock that triggers the next checkpoint, zero when off
+static int ckpt_reach[MAX_PROCS];   // leading ops of each proto the run may have looked at
+
+// Raise the reach of p's proto to what p has seen, the op at pc and one past it
+// A proto with a behavior is reached in full, its fetched ops are not known ahead
+static void ckpt_touch(const Process *p) {
+    const Process *t = &proto_procs[p->proto];
+    int r = t->behavior ? t->op_count : p->pc + 2;
+    if (r > t->op_count) r = t->op_count;
+    if (r > ckpt_reach[p->proto]) ckpt_reach[p->proto] = r;
+}
+
+// Queue one message for the coordinator, worker side of partition mode
+static void part_send(MsgKind kind, int node, int a, int b, int c) {
+    ShmMsg m = { kind, part_phase, node, a, b, c };
+    ring_push(part_out, &m);
+}
+
 // Map token text to an opcode
 static OpType parse_op(const char *s) {
     if (strcmp(s, "DOOP") == 0)  return DOOP;
@@ -84,14 +512,82 @@ static OpType parse_op(const char *s) {
     if (strcmp(s, "SEND")  == 0) return SEND;
     if (strcmp(s, "RECV")  == 0) return RECV;
     if (strcmp(s, "HALT")  == 0) return HALT;
+    if (strcmp(s, "SPAWN") == 0) return SPAWN;
+    if (strcmp(s, "EXIT")  == 0) return EXIT;
+    if (strcmp(s, "DEADLINE") == 0) return DEADLINE;
     return INVALID;  // unknown token is not a HALT
 }
 
+// One token of lookahead so optional operands can be given back
+static char tok_back[MAX_TOK];
+static int  tok_has_back = 0;
+
+// Read next whitespace separated token from input
+static int next_token(char *buf) {
+    if (tok_has_back) {
+        strcpy(buf, tok_back);
+        tok_has_back = 0;
+        return 1;
+    }
+    return scanf("%63s", buf) == 1;
+}
+
+// Push one token back so the next read returns it again
+static void unread_token(const char *buf) {
+    strcpy(tok_back, buf);
+    tok_has_back = 1;
+}
+
+// Parse a DOOP or BLOCK operand: plain ticks, U(lo,hi), E(mean) or L(mu,sigma)
+static int parse_operand(const char *s, Operation *op) {
+    char c; int n = 0;
+    op->dist = DIST_FIXED; op->d1 = op->d2 = 0;
+    if (sscanf(s, "%d%n", &op->a, &n) == 1 && s[n] == '\0') return 1;
+    op->a = 0;
+    if (sscanf(s, "U(%lf,%lf%c%n", &op->d1, &op->d2, &c, &n) == 3 && c == ')' && s[n] == '\0'
+        && op->d1 <= op->d2) {
+        op->dist = DIST_UNIFORM; return 1;
+    }
+    if (sscanf(s, "E(%lf%c%n", &op->d1, &c, &n) == 2 && c == ')' && s[n] == '\0' && op->d1 > 0) {
+        op->dist = DIST_EXP; return 1;
+    }
+    if (sscanf(s, "L(%lf,%lf%c%n", &op->d1, &op->d2, &c, &n) == 3 && c == ')' && s[n] == '\0'
+        && op->d2 >= 0) {
+        op->dist = DIST_LOGNORMAL; return 1;
+    }
+    return 0;
+}
+
+// Shared object and symbol named by the last PLUGIN line read
+static char plugin_path[256], plugin_sym[MAX_TOK];
+
+// Intern a SPAWN template name, returns its slot
+static int spawn_name_slot(const char *name) {
+    for (int i = 0; i < spawn_name_count; ++i)
+        if (strcmp(spawn_names[i], name) == 0) return i;
+    if (spawn_name_count == MAX_PROCS) {
+        fprintf(stderr, "prosim: too many SPAWN templates\n");
+        exit(1);
+    }
+    snprintf(spawn_names[spawn_name_count], sizeof spawn_names[0], "%s", name);
+    return spawn_name_count++;
+}
+
+// Append one op, programs longer than MAX_OPS after LOOP expansion are rejected
+static void emit_op(Operation *out, int *outc, Operation op) {
+    if (*outc >= MAX_OPS) {
+        fprintf(stderr, "prosim: program longer than %d ops after LOOP expansion\n", MAX_OPS);
+        exit(1);
+    }
+    out[(*outc)++] = op;
+}
+
 // Read program with LOOP blocks expanded
 // stop_on_end controls return when END appears inside body
+// Returns one at HALT, two at PLUGIN with its names in plugin_path and plugin_sym
 static int parse_block_into(Operation *out, int *outc, int stop_on_end) {
-    char tok[16];
-    while (scanf("%15s", tok) == 1) {
+    char tok[MAX_TOK];
+    while (next_token(tok)) {
         if (strcmp(tok, "END") == 0) {
             if (stop_on_end) return 0;   // end of a LOOP body
             continue;
@@ -105,21 +601,72 @@ static int parse_block_into(Operation *out, int *outc, int stop_on_end) {
             parse_block_into(tmp, &tc, 1);   // read until END
 
             for (int r = 0; r < times; ++r) {
-                for (int i = 0; i < tc; ++i) out[(*outc)++] = tmp[i];
+                for (int i = 0; i < tc; ++i) emit_op(out, outc, tmp[i]);
             }
             continue;
         }
 
+        if (strcmp(tok, "PLUGIN") == 0) {
+            if (stop_on_end) {
+                fprintf(stderr, "prosim: PLUGIN cannot appear inside LOOP\n");
+                exit(1);
+            }
+            if (scanf("%255s", plugin_path) != 1 || !next_token(plugin_sym)) {
+                fprintf(stderr, "prosim: PLUGIN needs a library and a symbol\n");
+                exit(1);
+            }
+            return 2;  // rest of the program comes from the plugin
+        }
+
         OpType t = parse_op(tok);
         if (t == HALT) {
-            out[*outc] = (Operation){ .type = HALT, .a = 0 };
-            (*outc)++;
+            emit_op(out, outc, (Operation){ .type = HALT, .a = 0 });
             return 1;  // program ends
         }
+        if (t == EXIT) {
+            emit_op(out, outc, (Operation){ .type = EXIT, .a = 0 });
+            return 1;  // program ends and its record is recycled
+        }
+        if (t == SPAWN) {
+            // SPAWN template node
+            char name[MAX_TOK]; int node = 0;
+            if (!next_token(name) || scanf("%d", &node) != 1) {
+                fprintf(stderr, "prosim: SPAWN needs a template name and a node\n");
+                exit(1);
+            }
+            emit_op(out, outc, (Operation){ .type = SPAWN, .a = node, .b = spawn_name_slot(name) });
+            continue;
+        }
+        if (t == DEADLINE) {
+            int ticks = 0;
+            if (scanf("%d", &ticks) != 1 || ticks < 1) {
+                fprintf(stderr, "prosim: DEADLINE needs a positive tick count\n");
+                exit(1);
+            }
+            emit_op(out, outc, (Operation){ .type = DEADLINE, .a = ticks });
+            workload_has_deadlines = 1;
+            continue;
+        }
         if (t == DOOP || t == BLOCK || t == SEND || t == RECV) {
-            int arg = 0; (void)scanf("%d", &arg);
-            out[*outc] = (Operation){ .type = t, .a = arg };
-            (*outc)++;
+            Operation op = { .type = t };
+            char arg[MAX_TOK];
+            if (next_token(arg)) {
+                int ok = (t == DOOP || t == BLOCK) ? parse_operand(arg, &op)
+                                                   : sscanf(arg, "%d", &op.a) == 1;
+                if (!ok) { op.a = 0; op.dist = DIST_FIXED; unread_token(arg); }
+                // SEND or RECV address TIMEOUT ticks
+                else if ((t == SEND || t == RECV) && next_token(arg)) {
+                    if (strcmp(arg, "TIMEOUT") != 0) {
+                        unread_token(arg);
+                    } else if (scanf("%d", &op.b) != 1 || op.b < 1) {
+                        fprintf(stderr, "prosim: TIMEOUT needs a positive tick count\n");
+                        exit(1);
+                    } else {
+                        workload_has_timeouts = 1;
+                    }
+                }
+            }
+            emit_op(out, outc, op);
             continue;
         }
 
@@ -128,32 +675,388 @@ static int parse_block_into(Operation *out, int *outc, int stop_on_end) {
     return 0;
 }
 
+/* --------- random operands --------- */
+// splitmix64 step, used both to seed and to draw
+static uint64_t rng_next(uint64_t *s) {
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Uniform double in [0, 1)
+static double rng_unit(uint64_t *s) {
+    return (rng_next(s) >> 11) * 0x1.0p-53;
+}
+
+// Draw ticks for one operand, never below one so a BLOCK always has a wake time
+static int draw_ticks(const Operation *op, uint64_t *s) {
+    double x = 0;
+    switch (op->dist) {
+    case DIST_FIXED:   return op->a;
+    case DIST_UNIFORM: {
+        double lo = floor(op->d1), hi = floor(op->d2);
+        x = lo + floor(rng_unit(s) * (hi - lo + 1));
+        break;
+    }
+    case DIST_EXP:     x = -op->d1 * log(1.0 - rng_unit(s)); break;
+    case DIST_LOGNORMAL: {
+        double u1 = rng_unit(s), u2 = rng_unit(s);
+        double z = sqrt(-2.0 * log(1.0 - u1)) * cos(2.0 * M_PI * u2);
+        x = exp(op->d1 + op->d2 * z);
+        break;
+    }
+    }
+    if (x > 0x3fffffff / 2) x = 0x3fffffff / 2;
+    int t = (int)(x + 0.5);
+    return t < 1 ? 1 : t;
+}
+
+/* --------- trace filter --------- */
+static const char *event_text[EV_COUNT] = {
+    "new", "ready", "running", "blocked", "blocked (send)", "blocked (recv)", "finished",
+    "crashed"
+};
+
+static void mask_set(uint64_t *m, int bit) { m[bit >> 6] |= 1ULL << (bit & 63); }
+static int  mask_get(const uint64_t *m, int bit) { return (int)(m[bit >> 6] >> (bit & 63)) & 1; }
+
+// Default filter lets everything through
+static void trace_filter_all(void) {
+    memset(trace_nodes, 0xff, sizeof trace_nodes);
+    memset(trace_pids,  0xff, sizeof trace_pids);
+    trace_events = (1u << EV_COUNT) - 1;
+    trace_t_lo = 0; trace_t_hi = 0x3fffffff;
+}
+
+// Silence every trace line, used by runs that only want the summary
+static void trace_filter_none(void) { trace_events = 0; }
+
+// Parse a list like 1-3,7 into mask bits below limit
+static int parse_ranges(const char *v, uint64_t *m, int limit) {
+    while (*v) {
+        char *end;
+        long lo = strtol(v, &end, 10), hi = lo;
+        if (end == v) return 0;
+        if (*end == '-') { v = end + 1; hi = strtol(v, &end, 10); if (end == v) return 0; }
+        if (lo < 0 || hi >= limit || lo > hi) return 0;
+        for (long b = lo; b <= hi; ++b) mask_set(m, (int)b);
+        v = end;
+        if (*v == ',') v++;
+        else if (*v) return 0;
+    }
+    return 1;
+}
+
+// Compile clauses like "node=1-3,5;pid=1;state=running,blocked;time=100-200"
+// Clauses are separated by ';' or spaces, a key given twice is a union
+static int trace_filter_compile(const char *expr) {
+    char buf[512];
+    int seen_node = 0, seen_pid = 0, seen_state = 0;
+    if (strlen(expr) >= sizeof buf) return 0;
+    strcpy(buf, expr);
+    for (char *save = NULL, *cl = strtok_r(buf, "; ", &save); cl; cl = strtok_r(NULL, "; ", &save)) {
+        char *v = strchr(cl, '=');
+        if (!v) return 0;
+        *v++ = '\0';
+        if (strcmp(cl, "node") == 0) {
+            if (!seen_node++) memset(trace_nodes, 0, sizeof trace_nodes);
+            if (!parse_ranges(v, trace_nodes, MAX_NODES + 1)) return 0;
+        } else if (strcmp(cl, "pid") == 0) {
+            if (!seen_pid++) memset(trace_pids, 0, sizeof trace_pids);
+            if (!parse_ranges(v, trace_pids, PID_BITS)) return 0;
+        } else if (strcmp(cl, "state") == 0) {
+            if (!seen_state++) trace_events = 0;
+            for (char *s2 = NULL, *k = strtok_r(v, ",", &s2); k; k = strtok_r(NULL, ",", &s2)) {
+                if      (strcmp(k, "new") == 0)      trace_events |= 1u << EV_NEW;
+                else if (strcmp(k, "ready") == 0)    trace_events |= 1u << EV_READY;
+                else if (strcmp(k, "running") == 0)  trace_events |= 1u << EV_RUNNING;
+                else if (strcmp(k, "block") == 0)    trace_events |= 1u << EV_BLOCKED;
+                else if (strcmp(k, "send") == 0)     trace_events |= 1u << EV_BLOCKED_SEND;
+                else if (strcmp(k, "recv") == 0)     trace_events |= 1u << EV_BLOCKED_RECV;
+                else if (strcmp(k, "blocked") == 0)
+                    trace_events |= (1u << EV_BLOCKED) | (1u << EV_BLOCKED_SEND) | (1u << EV_BLOCKED_RECV);
+                else if (strcmp(k, "finished") == 0) trace_events |= 1u << EV_FINISHED;
+                else if (strcmp(k, "crashed") == 0)  trace_events |= 1u << EV_CRASHED;
+                else return 0;
+            }
+        } else if (strcmp(cl, "time") == 0) {
+            char *end;
+            trace_t_lo = (int)strtol(v, &end, 10);
+            if (end == v || *end != '-') return 0;
+            v = end + 1;
+            trace_t_hi = *v ? (int)strtol(v, &end, 10) : 0x3fffffff;
+            if (*v && (end == v || *end)) return 0;
+            if (trace_t_lo < 0 || trace_t_hi < trace_t_lo) return 0;
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// All filter tests folded into one value so a rejected line costs one branch
+static inline int trace_wanted(int node_id, int time, int node_pid, Event ev) {
+    return mask_get(trace_nodes, node_id)
+         & mask_get(trace_pids, node_pid & (PID_BITS - 1))
+         & (int)(trace_events >> ev)
+         & ((unsigned)(time - trace_t_lo) <= (unsigned)(trace_t_hi - trace_t_lo));
+}
 
 // Print one state change line in required format
-static void print_state(int node_id, int time, int node_pid, const char *state) {
-    printf("[%02d] %05d: process %d %s\n", node_id, time, node_pid, state);
+static void print_state(int node_id, int time, int node_pid, Event ev) {
+    if (part_out) { part_send(MSG_STATE, node_id, time, node_pid, ev); return; }
+    sim_events++;
+    if (!trace_wanted(node_id, time, node_pid, ev)) return;
+    if (trace_file) {
+        char line[96];
+        int n = snprintf(line, sizeof line, "[%02d] %05d: process %d %s\n",
+                         node_id, time, node_pid, event_text[ev]);
+        if (tf_event(trace_file, node_id, time, node_pid, line, (size_t)n) != 0) {
+            fprintf(stderr, "prosim: cannot write %s\n", opt_trace_file);
+            exit(1);
+        }
+        return;
+    }
+    printf("[%02d] %05d: process %d %s\n", node_id, time, node_pid, event_text[ev]);
+    if (ckpt_next) buf_printf(&ckpt_seg, "[%02d] %05d: process %d %s\n", node_id, time, node_pid, event_text[ev]);
 }
 
 // Check if next instruction is HALT
+static int proc_has_op(Process *p);
 static int next_is_halt(Process *p) {
-    return (p->pc < p->op_count && p->ops[p->pc].type == HALT);
+    return (proc_has_op(p) && (p->ops[p->pc].type == HALT || p->ops[p->pc].type == EXIT));
 }
 
 // Address helpers for SEND and RECV
-static int addr_node(int addr) { return addr / 100; }
-static int addr_pid (int addr) { return addr % 100; }
-static int proc_addr(Process *p) { return p->node * 100 + p->node_pid; }
+static int proc_addr(Process *p) { return p->home; }
+
+/* --------- behavior plugins --------- */
+// Resolve "symbol[:arg]" in a shared object, exits on failure
+static ps_behavior load_behavior(const char *path, char *sym, const char **arg) {
+    char *colon = strchr(sym, ':');
+    *arg = "";
+    if (colon) { *colon = '\0'; *arg = strdup(colon + 1); }
+
+    void *lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!lib) {
+        fprintf(stderr, "prosim: %s\n", dlerror());
+        exit(1);
+    }
+    ps_behavior fn;
+    *(void **)&fn = dlsym(lib, sym);
+    if (!fn) {
+        fprintf(stderr, "prosim: %s has no behavior %s\n", path, sym);
+        exit(1);
+    }
+    return fn;
+}
+
+// Ask the behavior for one op and load it as the only op at pc
+static int plugin_fetch(Process *p) {
+    static const OpType kinds[] = { DOOP, BLOCK, SEND, RECV, HALT };
+    ps_ctx *c = &p->ctx;
+    c->node = p->node; c->pid = p->node_pid; c->addr = proc_addr(p);
+    c->now = nodes[p->node].clock;
+    c->sends = p->sends; c->recvs = p->recvs;
+
+    ps_op op = { PS_HALT, 0, 0 };
+    if (!p->behavior(c, &op) || op.kind < PS_DOOP || op.kind > PS_HALT) op.kind = PS_HALT;
+
+    Operation o = { .type = kinds[op.kind], .a = op.arg };
+    if ((o.type == SEND || o.type == RECV) && op.timeout > 0) o.b = op.timeout;
+    if (o.type == HALT) {
+        o.a = 0;
+        p->behavior = NULL;   // done, never call it again
+    } else if ((o.type == DOOP || o.type == BLOCK) && o.a < 1) {
+        o.a = 1;              // zero ticks would never finish or never wake
+    }
+    p->ops[0] = o;
+    p->op_count = 1;
+    p->pc = 0;
+    return 1;
+}
+
+// True when p has an op at pc, pulling the next one from its behavior if needed
+static int proc_has_op(Process *p) {
+    if (p->pc < p->op_count) return 1;
+    return p->behavior ? plugin_fetch(p) : 0;
+}
+
+/* --------- ready queue --------- */
+// Share weight, priority taken as a weight with a floor of one
+static int proc_weight(const Process *p) {
+    return p->priority > 0 ? p->priority : 1;
+}
+
+// Heap order for keyed policies, true when a runs before b
+// EDF: earliest deadline first, procs without one last
+// fair and stride: least weighted virtual runtime (pass) first
+// FIFO among equals in all
+static int rq_before(const Process *a, const Process *b) {
+    if (opt_sched == POLICY_EDF) {
+        unsigned da = a->deadline ? (unsigned)a->deadline : UINT_MAX;
+        unsigned db = b->deadline ? (unsigned)b->deadline : UINT_MAX;
+        if (da != db) return da < db;
+    } else if (opt_sched == POLICY_FAIR || opt_sched == POLICY_STRIDE) {
+        if (a->vruntime != b->vruntime) return a->vruntime < b->vruntime;
+    }
+    return (int)(a->rq_seq - b->rq_seq) < 0;
+}
+
+// Round robin and gang keep ready as a FIFO array, keyed policies keep it as a binary heap
+static int rq_fifo(void) {
+    return opt_sched == POLICY_RR || opt_sched == POLICY_GANG;
+}
+
+// Gang owning the time slot at t, slots are one quantum long and cycle through
+// the gangs, so nodes with the same clock favor members of the same gang
+static int gang_active(const Node *nd, int t) {
+    return gang_count ? (t / nd->quantum) % gang_count + 1 : 0;
+}
+
+// Procs waiting for the cpu on nd, in either queue
+static int rq_len(const Node *nd) {
+    return nd->ready_count + nd->comm_count;
+}
+
+// Fenwick tree over node pids, add t tickets at pid
+static void lot_add(Node *nd, int pid, int t) {
+    for (int i = pid; i <= LOT_SLOTS; i += i & -i) nd->tickets[i] += t;
+}
+
+// Pid holding ticket number r, zero based, in pid order
+static int lot_find(const Node *nd, int r) {
+    int pos = 0;
+    for (int step = LOT_SLOTS; step; step >>= 1) {
+        if (pos + step <= LOT_SLOTS && nd->tickets[pos + step] <= r) {
+            pos += step;
+            r -= nd->tickets[pos];
+        }
+    }
+    return pos + 1;
+}
+
+// Draw a ready proc with chance proportional to its tickets, O(log n)
+static Process *lot_draw(Node *nd) {
+    int total = nd->tickets[LOT_SLOTS];
+    Process *p = nd->lot_proc[lot_find(nd, (int)(rng_next(&nd->lot_rng) % (uint64_t)total))];
+    lot_add(nd, p->node_pid, -proc_weight(p));
+    nd->lot_proc[p->node_pid] = NULL;
+    Process *last = nd->ready[--nd->ready_count];
+    nd->ready[p->rq_pos] = last;
+    last->rq_pos = p->rq_pos;
+    return p;
+}
+
+static void rq_push(Node *nd, Process *p) {
+    p->rq_seq = nd->rq_seq++;
+    if (p->rdv_released && opt_comm_boost) {
+        // just matched, FIFO queue served ahead of the policy's own
+        p->rdv_released = 0;
+        nd->comm[nd->comm_count++] = p;
+        return;
+    }
+    p->rdv_released = 0;
+    // a proc back from blocking or just arrived starts at the node's current vruntime
+    // so it cannot claim the time it spent away in one long burst
+    if (opt_sched == POLICY_FAIR && p->vruntime < nd->min_vruntime) p->vruntime = nd->min_vruntime;
+    // stride keeps the distance to the node's pass it had when it left, credit or debt
+    if (opt_sched == POLICY_STRIDE && p->away) p->vruntime = nd->min_vruntime + p->pass_left;
+    p->away = 0;
+    int i = nd->ready_count++;
+    if (opt_sched == POLICY_LOTTERY) {
+        nd->ready[i] = p;
+        p->rq_pos = i;
+        nd->lot_proc[p->node_pid] = p;
+        lot_add(nd, p->node_pid, proc_weight(p));
+        return;
+    }
+    if (rq_fifo()) { nd->ready[i] = p; return; }
+    while (i > 0) {
+        int up = (i - 1) / 2;
+        if (!rq_before(p, nd->ready[up])) break;
+        nd->ready[i] = nd->ready[up];
+        i = up;
+    }
+    nd->ready[i] = p;
+}
+
+static Process *rq_pop(Node *nd) {
+    // comm queue first, but after opt_comm_boost such dispatches in a row the
+    // regular queue gets one so a busy pipeline cannot starve it
+    if (nd->comm_count && (nd->comm_streak < opt_comm_boost || nd->ready_count == 0)) {
+        Process *c = nd->comm[0];
+        for (int j = 0; j < nd->comm_count - 1; ++j) nd->comm[j] = nd->comm[j + 1];
+        nd->comm_count--;
+        nd->comm_streak++;
+        return c;
+    }
+    nd->comm_streak = 0;
+    if (opt_sched == POLICY_LOTTERY) return lot_draw(nd);
+    Process *top = nd->ready[0];
+    if (rq_fifo()) {
+        // gang: first member of the slot's gang, else the head so the slot is not wasted
+        int k = 0, g = opt_sched == POLICY_GANG ? gang_active(nd, nd->clock) : 0;
+        if (g) {
+            for (int j = 0; j < nd->ready_count; ++j)
+                if (nd->ready[j]->gang == g) { k = j; break; }
+            top = nd->ready[k];
+        }
+        for (int j = k; j < nd->ready_count - 1; ++j) nd->ready[j] = nd->ready[j + 1];
+        nd->ready_count--;
+        return top;
+    }
+    Process *last = nd->ready[--nd->ready_count];
+    int i = 0, n = nd->ready_count;
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= n) break;
+        if (c + 1 < n && rq_before(nd->ready[c + 1], nd->ready[c])) c++;
+        if (!rq_before(nd->ready[c], last)) break;
+        nd->ready[i] = nd->ready[c];
+        i = c;
+    }
+    if (n > 0) nd->ready[i] = last;
+    if (top->vruntime > nd->min_vruntime) nd->min_vruntime = top->vruntime;
+    return top;
+}
+
+// Account ticks p just ran for fair and stride and the share report
+static void fair_charge(Node *nd, Process *p, int ticks) {
+    p->vruntime += (long long)ticks * FAIR_UNIT / proc_weight(p);
+    if (!nd->finished_count) p->run_contended += ticks;
+}
+
+/* --------- deadlines --------- */
+// End the current segment at time now and score it
+static void deadline_close(Process *p, int now) {
+    if (!p->deadline) return;
+    p->deadlines++;
+    if (now > p->deadline) { p->missed++; p->lateness += now - p->deadline; }
+    p->deadline = 0;
+}
+
+// Leading DEADLINE ops count from arrival so EDF can order p while it waits
+static void deadline_arrive(Process *p, int now) {
+    while (p->pc < p->op_count && p->ops[p->pc].type == DEADLINE) {
+        p->deadline = now + p->ops[p->pc].a;
+        p->pc++;
+    }
+}
 
 /* READY / BLOCKED / PENDING management */
 // Put proc into READY queue and log state
 static void add_ready(Node *nd, Process *p) {
     p->state = READY;
-    print_state(nd->node_id, nd->clock, p->node_pid, "ready");
-    nd->ready[nd->ready_count++] = p;
+    print_state(nd->node_id, nd->clock, p->node_pid, EV_READY);
+    rq_push(nd, p);
 }
 
 // Append to BLOCKED list on this node
 static void add_blocked(Node *nd, Process *p) {
+    p->pass_left = p->vruntime - nd->min_vruntime;
+    p->away = 1;
     nd->blocked[nd->blocked_count++] = p;
 }
 
@@ -183,13 +1086,30 @@ static void add_wait_ready(Node *nd, int dt) {
     for (int i = 0; i < nd->ready_count; ++i) {
         nd->ready[i]->wait_time += dt;
     }
+    for (int i = 0; i < nd->comm_count; ++i) nd->comm[i]->wait_time += dt;
 }
 
 /* global blocked registry */
 // Add one proc to global list so matcher can see it
-static void glob_add(Process *p) { glob_blocked[glob_blocked_count++] = p; }
+static void glob_add(Process *p) {
+    if (opt_reference) { glob_blocked[glob_blocked_count++] = p; return; }
+    // a live address belongs to one proc, so a slot holds at most one blocked proc
+    p->glob_prev = glob_tail;
+    p->glob_next = NULL;
+    if (glob_tail) glob_tail->glob_next = p; else glob_head = p;
+    glob_tail = p;
+    glob_at[proc_addr(p)] = p;
+    glob_blocked_count++;
+}
 // Remove one proc from global list
 static void glob_remove(Process *p) {
+    if (!opt_reference) {
+        if (p->glob_prev) p->glob_prev->glob_next = p->glob_next; else glob_head = p->glob_next;
+        if (p->glob_next) p->glob_next->glob_prev = p->glob_prev; else glob_tail = p->glob_prev;
+        glob_at[proc_addr(p)] = NULL;
+        glob_blocked_count--;
+        return;
+    }
     for (int i = 0; i < glob_blocked_count; ++i) {
         if (glob_blocked[i] == p) {
             for (int j = i; j < glob_blocked_count - 1; ++j)
@@ -201,17 +1121,78 @@ static void glob_remove(Process *p) {
 }
 
 /* --------- matching logic (cross-node) --------- */
+// Charge the time a matched party spent blocked until its release at due
+static void rdv_release(Node *nd, Process *p, int due) {
+    int w = due > p->rdv_since ? due - p->rdv_since : 0;
+    p->rdv_wait += w;
+    nd->rdv_wait += w;
+    nd->rendezvous++;
+    p->rdv_released = 1;
+}
+
+// Message from s reaches r at due, r now carries the origin of the chain
+// A sender that never received is the source, its data left when it blocked
+static void chain_pass(Process *s, Process *r, int due) {
+    r->chain_origin = s->recvs ? s->chain_origin : s->rdv_since;
+    if (!r->chain_sink) return;
+    Node *nd = &nodes[r->node];
+    int lat = due - r->chain_origin;
+    nd->chain_msgs++;
+    nd->chain_sum += lat;
+    if (lat > nd->chain_max) nd->chain_max = lat;
+}
+
+// Sender s meets receiver r, both get scheduled for the next tick on their own nodes
+static void rdv_match(Node *trigger_node, Process *s, Process *r) {
+    // consume ops and update stats
+    s->pc++; s->sends++;
+    r->pc++; r->recvs++;
+    s->ctx.last_status = r->ctx.last_status = PS_OK;
+
+    Node *nd_s = &nodes[s->node];
+    Node *nd_r = &nodes[r->node];
+
+    remove_blocked(nd_s, s);
+    remove_blocked(nd_r, r);
+    nd_s->messages++; nd_r->messages++;
+    glob_remove(s);
+    glob_remove(r);
+
+    int due = trigger_node->clock + 1;                   // release on next tick
+    rdv_release(nd_s, s, due);
+    rdv_release(nd_r, r, due);
+    chain_pass(s, r, due);
+    add_pending(nd_s, s, due, next_is_halt(s) ? 1 : 0);
+    add_pending(nd_r, r, due, next_is_halt(r) ? 1 : 0);
+}
+
+// Blocked proc at addr, NULL when there is none or addr is out of range
+static Process *glob_find(int addr) {
+    return addr > 0 && addr < ADDR_SLOTS ? glob_at[addr] : NULL;
+}
+
 // Try to match a sender with its receiver now
 // On success both get scheduled for next tick on own nodes
 static int try_match_now(Node *trigger_node, Process *p) {
     if (p->state != BLOCKED) return 0;
 
-    int my_addr = proc_addr(p);
+    if (!opt_reference) {
+        // the partner can only be the proc at the address p names
+        if (p->want_dst_addr > 0) {
+            Process *q = glob_find(p->want_dst_addr);
+            if (!q || q == p || q->state != BLOCKED || q->want_src_addr != proc_addr(p)) return 0;
+            rdv_match(trigger_node, p, q);
+        } else if (p->want_src_addr > 0) {
+            Process *q = glob_find(p->want_src_addr);
+            if (!q || q == p || q->state != BLOCKED || q->want_dst_addr != proc_addr(p)) return 0;
+            rdv_match(trigger_node, q, p);
+        } else {
+            return 0;
+        }
+        return 1;
+    }
 
     if (p->want_dst_addr > 0) {
-        // p is sender, seek waiting receiver q that expects p and sits at want_dst_addr
-        int destN = addr_node(p->want_dst_addr);
-        int destP = addr_pid (p->want_dst_addr);
         /* sender p: find a receiver q such that:
    - q is BLOCKED on RECV
    - p -> want_dst_addr == address(q)
@@ -223,29 +1204,11 @@ static int try_match_now(Node *trigger_node, Process *p) {
             if (q->want_src_addr <= 0) continue;                 // q must be a receiver
             if (p->want_dst_addr != proc_addr(q)) continue;      // p targets q
             if (q->want_src_addr != proc_addr(p)) continue;      // q expects p
-
-            // consume ops and update stats
-            p->pc++; p->sends++;
-            q->pc++; q->recvs++;
-
-            Node *nd_s = &nodes[p->node];
-            Node *nd_r = &nodes[q->node];
-
-            remove_blocked(nd_s, p);
-            remove_blocked(nd_r, q);
-            glob_remove(p);
-            glob_remove(q);
-
-            int due = trigger_node->clock + 1;                   // release on next tick
-            add_pending(nd_s, p, due, next_is_halt(p) ? 1 : 0);
-            add_pending(nd_r, q, due, next_is_halt(q) ? 1 : 0);
+            rdv_match(trigger_node, p, q);
             return 1;
         }
 
     } else if (p->want_src_addr > 0) {
-        // p is receiver, seek sender s that names p and aims for p
-        int srcN = addr_node(p->want_src_addr);
-        int srcP = addr_pid (p->want_src_addr);
         /* receiver p: find a sender s such that:
    - s is BLOCKED on SEND
    - s -> want_dst_addr == address(p)
@@ -257,30 +1220,68 @@ static int try_match_now(Node *trigger_node, Process *p) {
             if (s->want_dst_addr <= 0) continue;                 // s must be a sender
             if (s->want_dst_addr != proc_addr(p)) continue;      // s targets p
             if (p->want_src_addr != proc_addr(s)) continue;      // p expects s
+            rdv_match(trigger_node, s, p);
+            return 1;
+        }
 
-            s->pc++; s->sends++;
-            p->pc++; p->recvs++;
+    }
+    return 0;
+}
 
-            Node *nd_s = &nodes[s->node];
-            Node *nd_r = &nodes[p->node];
+// The SEND or RECV p blocked on timed out, skip it with a failure status
+static void rdv_timeout(Node *nd, Process *p) {
+    if (part_out) part_send(MSG_GIVEUP, nd->node_id, p->node_pid, 0, 0);
+    else glob_remove(p);
+    p->want_dst_addr = p->want_src_addr = 0;
+    p->unblock_time = 0;
+    p->pc++;
+    p->timeouts++;
+    nd->timeouts++;
+    p->ctx.last_status = PS_TIMEOUT;
+}
 
-            remove_blocked(nd_s, s);
-            remove_blocked(nd_r, p);
-            glob_remove(s);
-            glob_remove(p);
+// Proc at addr was lost in a crash under --fault-policy fail and never comes back
+static int addr_crashed(int addr) {
+    int n = addr / 100;
+    if (n < 1 || n > num_nodes) return 0;
+    for (int i = 0; i < nodes[n].proc_count; ++i)
+        if (proc_addr(nodes[n].procs[i]) == addr) return nodes[n].procs[i]->state == CRASHED;
+    return 0;
+}
 
-            int due = trigger_node->clock + 1;
-            add_pending(nd_s, s, due, next_is_halt(s) ? 1 : 0);
-            add_pending(nd_r, p, due, next_is_halt(p) ? 1 : 0);
-            return 1;
-        }
+// The partner of the SEND or RECV p blocked on crashed, skip it with a failure
+// status and release p at due as a match would, the caller took it off the matcher
+static void rdv_fail(Node *nd, Process *p, int due) {
+    remove_blocked(nd, p);
+    p->want_dst_addr = p->want_src_addr = 0;
+    p->unblock_time = 0;
+    p->pc++;
+    nd->rdv_failed++;
+    p->ctx.last_status = PS_FAILED;
+    add_pending(nd, p, due, next_is_halt(p) ? 1 : 0);
+}
 
+// p just blocked on SEND or RECV, make it visible to the matcher and try it
+static void rdv_offer(Node *nd, Process *p) {
+    if (part_out) { part_send(MSG_RDV, nd->node_id, p->node_pid, 0, 0); return; }
+    if (fault_count && opt_fault_policy == FAULT_FAIL
+        && addr_crashed(p->want_dst_addr ? p->want_dst_addr : p->want_src_addr)) {
+        rdv_fail(nd, p, nd->clock + 1);
+        return;
     }
-    return 0;
+    glob_add(p);
+    Phase was = perf_enter(PH_MATCH);
+    (void)try_match_now(nd, p);
+    perf_enter(was);
 }
 
 // Search whole global list to create a match if possible
 static int sweep_global_matches(void) {
+    if (!opt_reference) {
+        for (Process *a = glob_head; a; a = a->glob_next)
+            if (a->state == BLOCKED && try_match_now(&nodes[a->node], a)) return 1;
+        return 0;
+    }
     for (int i = 0; i < glob_blocked_count; ++i) {
         Process *a = glob_blocked[i];
         if (a->state != BLOCKED) continue;
@@ -290,19 +1291,343 @@ static int sweep_global_matches(void) {
     return 0;
 }
 
+/* --------- sampling --------- */
+// Columnar store, one array per field, all of length count
+typedef struct {
+    int count, cap;
+    int *time, *node, *ready, *blocked, *pending, *messages;
+    unsigned char *busy;
+} Samples;
+
+static Samples samples;
+
+// Bytes per row across the columns above
+#define SAMPLE_ROW_BYTES (6 * sizeof(int) + 1)
+
+static void *grow(void *p, size_t elem, int cap) {
+    void *np = realloc(p, elem * (size_t)cap);
+    if (!np) { fprintf(stderr, "prosim: out of memory\n"); exit(1); }
+    return np;
+}
+
+// Append one row, amortized constant time
+static void sample_record(Node *nd, int t, int busy) {
+    Samples *s = &samples;
+    if (s->count == s->cap) {
+        int old = s->cap;
+        s->cap = s->cap ? s->cap * 2 : 1024;
+        mem_add(MEM_OUTPUT, (long long)(s->cap - old) * SAMPLE_ROW_BYTES);
+        s->time     = grow(s->time,     sizeof(int), s->cap);
+        s->node     = grow(s->node,     sizeof(int), s->cap);
+        s->ready    = grow(s->ready,    sizeof(int), s->cap);
+        s->blocked  = grow(s->blocked,  sizeof(int), s->cap);
+        s->pending  = grow(s->pending,  sizeof(int), s->cap);
+        s->messages = grow(s->messages, sizeof(int), s->cap);
+        s->busy     = grow(s->busy,     1,           s->cap);
+    }
+    int i = s->count++;
+    s->time[i]     = t;
+    s->node[i]     = nd->node_id;
+    s->ready[i]    = rq_len(nd);
+    s->blocked[i]  = nd->blocked_count;
+    s->pending[i]  = nd->pend_count;
+    s->messages[i] = nd->messages;
+    s->busy[i]     = (unsigned char)busy;
+}
+
+// Node clock is about to move to until, sample every boundary it passes
+// State in force now holds for the whole skipped span
+static void sample_until(Node *nd, int until, int busy) {
+    while (nd->next_sample < until) {
+        sample_record(nd, nd->next_sample, busy);
+        nd->next_sample += opt_sample_interval;
+    }
+}
+
+// Write all rows as CSV, or as a header followed by one raw int32 column at a time,
+// to standard output after the summary when the file is "-"
+static void sample_write(void) {
+    Samples *s = &samples;
+    int to_stdout = strcmp(opt_sample_out, "-") == 0;
+    FILE *f = to_stdout ? stdout : fopen(opt_sample_out, opt_sample_format == SAMPLE_BIN ? "wb" : "w");
+    if (!f) { fprintf(stderr, "prosim: cannot open %s\n", opt_sample_out); exit(1); }
+    if (opt_sample_format == SAMPLE_CSV) {
+        fprintf(f, "time,node,ready,blocked,pending,busy,messages\n");
+        for (int i = 0; i < s->count; ++i)
+            fprintf(f, "%d,%d,%d,%d,%d,%d,%d\n", s->time[i], s->node[i], s->ready[i],
+                    s->blocked[i], s->pending[i], s->busy[i], s->messages[i]);
+    } else {
+        // magic, column count, row count, interval, then columns in CSV order
+        int32_t hdr[4] = { 0x504d5350 /* "PSMP" */, 7, s->count, opt_sample_interval };
+        fwrite(hdr, sizeof hdr, 1, f);
+        int *cols[] = { s->time, s->node, s->ready, s->blocked, s->pending, NULL, s->messages };
+        for (int c = 0; c < 7; ++c) {
+            if (cols[c]) { if (s->count) fwrite(cols[c], sizeof(int), s->count, f); continue; }
+            for (int i = 0; i < s->count; ++i) {
+                int32_t v = s->busy[i];
+                fwrite(&v, sizeof v, 1, f);
+            }
+        }
+    }
+    if (to_stdout) fflush(f);
+    else fclose(f);
+    free(s->time); free(s->node); free(s->ready); free(s->blocked);
+    free(s->pending); free(s->messages); free(s->busy);
+    mem_add(MEM_OUTPUT, -(long long)s->cap * SAMPLE_ROW_BYTES);
+    memset(s, 0, sizeof *s);
+}
+
+/* --------- spawned process records --------- */
+// Draw every distribution operand of p from its own stream
+static void draw_ops(Process *p) {
+    for (int k = 0; k < p->op_count; ++k) {
+        Operation *op = &p->ops[k];
+        if (op->dist != DIST_FIXED) op->a = draw_ticks(op, &p->rng);
+    }
+}
+
+// Lowest free node pid, zero when all are taken
+static int pid_alloc(Node *nd) {
+    for (int pid = 1; pid <= MAX_NODE_PID; ++pid) {
+        if (!mask_get(nd->pid_used, pid)) { mask_set(nd->pid_used, pid); return pid; }
+    }
+    return 0;
+}
+
+static void pid_free(Node *nd, int pid) {
+    nd->pid_used[pid >> 6] &= ~(1ULL << (pid & 63));
+}
+
+// Add one chunk of records to the front of the node slab list and its free list
+static void slab_grow(Node *nd) {
+    Slab *sl = part_shm ? slab_pool : malloc(sizeof *sl);
+    if (!sl) { fprintf(stderr, "prosim: out of memory\n"); exit(1); }
+    if (part_shm) slab_pool = sl->next;
+    long long b[MEM_COUNT] = { 0 };
+    mem_procs(b, SLAB_PROCS);
+    mem_add_all(b, 1);
+    sl->next = nd->slabs;
+    nd->slabs = sl;
+    for (int i = SLAB_PROCS - 1; i >= 0; --i) {
+        sl->recs[i].next_free = nd->free_procs;
+        nd->free_procs = &sl->recs[i];
+    }
+}
+
+// Take a record from the node slab, growing it by one chunk when empty
+static Process *slab_alloc(Node *nd) {
+    if (!nd->free_procs) slab_grow(nd);
+    Process *p = nd->free_procs;
+    nd->free_procs = p->next_free;
+    return p;
+}
+
+static void slab_free_all(Node *nd) {
+    long long b[MEM_COUNT] = { 0 };
+    mem_procs(b, SLAB_PROCS);
+    while (nd->slabs) {
+        Slab *next = nd->slabs->next;
+        if (part_shm) {
+            nd->slabs->next = slab_pool;
+            slab_pool = nd->slabs;
+        } else {
+            free(nd->slabs);
+        }
+        mem_add_all(b, -1);
+        nd->slabs = next;
+    }
+    nd->free_procs = NULL;
+}
+
+// Create a proc from template tmpl on node target, it arrives at time now
+static void spawn_proc(Node *parent, int tmpl, int target, int now) {
+    if (part_out) { part_send(MSG_SPAWN, parent->node_id, tmpl, target, now); return; }
+    if (target < 1 || target > num_nodes) { parent->spawn_failed++; return; }
+    Node *nd = &nodes[target];
+    int down = now >= nd->down_from && now < nd->down_until;
+    int pid = nd->proc_count < MAX_PROCS && !down ? pid_alloc(nd) : 0;
+    if (!pid) { nd->spawn_failed++; return; }
+
+    Process *c = slab_alloc(nd);
+    *c = proto_procs[tmpl];
+    c->node = target;
+    c->node_pid = pid;
+    c->home = target * 100 + pid;
+    c->pid_global = total_procs + ++spawn_seq;
+    c->rng = sim_seed ^ ((uint64_t)c->pid_global << 32);
+    (void)rng_next(&c->rng);
+    uint64_t alt = c->rng ^ 0xd1b54a32d192ed03ULL;   // the split sim_reset makes
+    c->ctx.seed = rng_next(&alt);
+    draw_ops(c);
+    deadline_arrive(c, now);
+
+    nd->procs[nd->proc_count++] = c;
+    nd->spawned++;
+    add_pending(nd, c, now, 2);
+}
+
+// Fold an exited proc into node totals and give its pid back, and its record
+// when it came from a slab; workload procs keep theirs in all_procs
+static void proc_release(Node *nd, Process *p) {
+    if (part_out) { part_send(MSG_RELEASE, nd->node_id, p->node_pid, 0, 0); return; }
+    if (ckpt_next) ckpt_touch(p);   // its ops may count for the next checkpoint
+    nd->exited++;
+    nd->exited_run += p->run_time;
+    nd->exited_block += p->block_time;
+    nd->exited_wait += p->wait_time;
+    nd->exited_missed += p->missed;
+    for (int i = 0; i < nd->proc_count; ++i) {
+        if (nd->procs[i] == p) { nd->procs[i] = nd->procs[--nd->proc_count]; break; }
+    }
+    pid_free(nd, p->node_pid);
+    // a proc moved off a crashed node also held its old pid there
+    if (p->home / 100 != nd->node_id) pid_free(&nodes[p->home / 100], p->home % 100);
+    if (p->pid_global <= total_procs) return;
+    p->next_free = nd->free_procs;
+    nd->free_procs = p;
+}
+
+// p reached HALT or EXIT at pc, finish it now at zero cost
+static void proc_finish(Node *nd, Process *p) {
+    int recycle = (p->pc < p->op_count && p->ops[p->pc].type == EXIT);
+    p->pc++;
+    p->state = FINISHED;
+    p->finish_time = nd->clock;
+    nd->finished_count++;
+    sim_finished++;
+    deadline_close(p, nd->clock);
+    if (nd->clock > nd->last_finish) nd->last_finish = nd->clock;
+    print_state(nd->node_id, nd->clock, p->node_pid, EV_FINISHED);
+    if (recycle) proc_release(nd, p);
+}
+
+/* --------- node faults --------- */
+// Start p over from its program as pid on node to, arriving at due
+// It keeps its identity, address and lost work, counters start again
+static void proc_restart(Process *p, Node *to, int pid, int due) {
+    int gid = p->pid_global, home = p->home, lost = p->lost;
+    uint64_t seed = p->ctx.seed;
+    if (ckpt_next) ckpt_touch(p);   // the ops it ran before the crash still shaped the run
+    *p = proto_procs[p->proto];
+    p->node = to->node_id;
+    p->node_pid = pid;
+    p->pid_global = gid;
+    p->home = home;
+    p->lost = lost;
+    p->ctx.seed = seed;
+    p->rng = sim_seed ^ ((uint64_t)gid << 32);
+    (void)rng_next(&p->rng);
+    draw_ops(p);
+    deadline_arrive(p, due);
+    add_pending(to, p, due, 2);
+}
+
+// Live node other than from with the fewest procs at time t, NULL when there is none
+static Node *fault_target(const Node *from, int t) {
+    Node *best = NULL;
+    for (int n = 1; n <= num_nodes; ++n) {
+        Node *nd = &nodes[n];
+        if (nd == from || (t >= nd->down_from && t < nd->down_until)) continue;
+        if (nd->proc_count >= MAX_PROCS) continue;
+        if (!best || nd->proc_count < best->proc_count) best = nd;
+    }
+    return best;
+}
+
+// Take nd down for fault f, every proc it still had loses what it ran
+static void node_crash(Node *nd, const Fault *f) {
+    int now = nd->clock;
+    nd->faults_done++;
+    nd->crashes++;
+    nd->down_from = now;
+    nd->down_until = f->until;
+
+    Process *hit[MAX_PROCS];
+    int count = 0;
+    for (int i = 0; i < nd->proc_count; ++i) {
+        Process *p = nd->procs[i];
+        if (p->state == FINISHED || p->state == CRASHED) continue;
+        // a matched party is off the matcher already, its wish stays until release
+        if ((p->want_dst_addr || p->want_src_addr) && (opt_reference || glob_at[proc_addr(p)] == p))
+            glob_remove(p);
+        hit[count++] = p;
+    }
+    // queues go wholesale, each proc below ends up crashed or pending again
+    nd->ready_count = nd->comm_count = nd->comm_streak = 0;
+    nd->blocked_count = nd->pend_count = 0;
+    memset(nd->tickets, 0, sizeof nd->tickets);
+    memset(nd->lot_proc, 0, sizeof nd->lot_proc);
+
+    for (int i = 0; i < count; ++i) {
+        Process *p = hit[i];
+        print_state(nd->node_id, now, p->node_pid, EV_CRASHED);
+        p->lost += p->run_time;
+        nd->lost += p->run_time;
+        nd->crash_procs++;
+        Node *to = opt_fault_policy == FAULT_MIGRATE ? fault_target(nd, now) : NULL;
+        int pid = to ? pid_alloc(to) : 0;
+        if (pid) {
+            // the home pid stays taken so nothing else answers to its address,
+            // a pid it got on an earlier move is free again
+            for (int k = 0; k < nd->proc_count; ++k)
+                if (nd->procs[k] == p) { nd->procs[k] = nd->procs[--nd->proc_count]; break; }
+            if (p->home / 100 != nd->node_id) pid_free(nd, p->node_pid);
+            to->procs[to->proc_count++] = p;
+            proc_restart(p, to, pid, now);
+            nd->restarts++;
+        } else if (opt_fault_policy != FAULT_FAIL && f->until != 0x3fffffff) {
+            proc_restart(p, nd, p->node_pid, f->until);
+            nd->restarts++;
+        } else {
+            p->state = CRASHED;
+            p->finish_time = now;
+        }
+    }
+
+    if (opt_fault_policy != FAULT_FAIL) return;
+    // partners blocked on a lost proc give up, they would wait forever
+    for (int n = 1; n <= num_nodes; ++n) {
+        Node *o = &nodes[n];
+        for (int i = 0; i < o->blocked_count; ) {
+            Process *p = o->blocked[i];
+            int addr = p->want_dst_addr ? p->want_dst_addr : p->want_src_addr;
+            if (addr && addr_crashed(addr)) {
+                glob_remove(p);
+                rdv_fail(o, p, now + 1);
+            } else {
+                ++i;
+            }
+        }
+    }
+}
+
+// Crash every node whose clock reached its next scheduled fault
+static void fault_check(void) {
+    for (int i = 0; i < fault_count; ++i) {
+        Node *nd = &nodes[faults[i].node];
+        if (nd->faults_done == faults[i].seq && nd->clock >= faults[i].at) node_crash(nd, &faults[i]);
+    }
+}
+
+// Time of the next fault on nd, 0x3fffffff when none is left
+static int fault_next(const Node *nd) {
+    for (int i = 0; i < fault_count; ++i)
+        if (faults[i].node == nd->node_id && faults[i].seq == nd->faults_done) return faults[i].at;
+    return 0x3fffffff;
+}
+
 /* --------- per-node time helpers --------- */
 // Release any pending item due at current node clock
 static int node_flush_pending(Node *nd) {
     int progress = 0;
     for (int i = 0; i < nd->pend_count; ) {
         Pending *e = &nd->pend[i];
-        if (e->due_time == nd->clock) {
+        if (e->due_time <= nd->clock) {
             Process *p = e->p;
-            if (e->is_finish) {
-                p->state = FINISHED;
-                p->finish_time = nd->clock;
-                print_state(nd->node_id, nd->clock, p->node_pid, "finished");
+            if (e->is_finish == 1) {
+                proc_finish(nd, p);
             } else {
+                if (e->is_finish == 2) print_state(nd->node_id, nd->clock, p->node_pid, EV_NEW);
                 add_ready(nd, p);
             }
             // remove entry
@@ -322,15 +1647,13 @@ static int node_expire_block(Node *nd) {
     for (int i = 0; i < nd->blocked_count; ) {
         Process *p = nd->blocked[i];
         if (p->unblock_time > 0 && nd->clock >= p->unblock_time) {
-            // timed BLOCK complete
+            // timed BLOCK complete, or a SEND or RECV gave up on its partner
             for (int j = i; j < nd->blocked_count - 1; ++j) nd->blocked[j] = nd->blocked[j + 1];
             nd->blocked_count--;
             // normal BLOCK is not in global list
+            if (p->want_dst_addr || p->want_src_addr) rdv_timeout(nd, p);
             if (next_is_halt(p)) {
-                p->pc++; // HALT costs zero ticks in this trace
-                p->state = FINISHED;
-                p->finish_time = nd->clock;
-                print_state(nd->node_id, nd->clock, p->node_pid, "finished");
+                proc_finish(nd, p); // HALT costs zero ticks in this trace
             } else {
                 add_ready(nd, p);
             }
@@ -345,28 +1668,30 @@ static int node_expire_block(Node *nd) {
 /* run a single time slice on node nd using FIFO round robin */
 // Handles DOOP work, then control ops that yield early
 static int node_run_timeslice(Node *nd) {
-    if (nd->ready_count == 0) return 0;
+    if (rq_len(nd) == 0) return 0;
 
-    Process *p = nd->ready[0];
-    for (int j = 0; j < nd->ready_count - 1; ++j) nd->ready[j] = nd->ready[j + 1];
-    nd->ready_count--;
+    Process *p = rq_pop(nd);
 
-    if (p->state == FINISHED || p->pc >= p->op_count) return 1;
+    if (p->state == FINISHED || !proc_has_op(p)) return 1;
 
     p->state = RUNNING;
-    print_state(nd->node_id, nd->clock, p->node_pid, "running");
+    nd->dispatches++;
+    print_state(nd->node_id, nd->clock, p->node_pid, EV_RUNNING);
 
     int used = 0;
     int yielded = 0;
 
-    while (used < nd->quantum && p->pc < p->op_count) {
+    while (used < nd->quantum && proc_has_op(p)) {
         Operation *op = &p->ops[p->pc];
 
         if (op->type == DOOP) {
             int run_ticks = op->a;
             if (run_ticks > nd->quantum - used) run_ticks = nd->quantum - used;
             add_wait_ready(nd, run_ticks);
+            if (opt_sample_interval) sample_until(nd, nd->clock + run_ticks, 1);
             p->run_time += run_ticks;
+            nd->busy_time += run_ticks;
+            fair_charge(nd, p, run_ticks);
             nd->clock   += run_ticks;
             used        += run_ticks;
             op->a       -= run_ticks;
@@ -376,8 +1701,9 @@ static int node_run_timeslice(Node *nd) {
             int ticks = op->a;
             p->block_time   += ticks;
             p->unblock_time  = nd->clock + ticks;
+            p->want_dst_addr = p->want_src_addr = 0;   // a plain BLOCK, not a rendezvous
             p->state         = BLOCKED;
-            print_state(nd->node_id, nd->clock, p->node_pid, "blocked");
+            print_state(nd->node_id, nd->clock, p->node_pid, EV_BLOCKED);
             p->pc++; // consume BLOCK
             add_blocked(nd, p);
             yielded = 1;
@@ -386,46 +1712,67 @@ static int node_run_timeslice(Node *nd) {
         else if (op->type == SEND) {
             // one tick to attempt send, then block as sender
             add_wait_ready(nd, 1);
+            if (opt_sample_interval) sample_until(nd, nd->clock + 1, 1);
             p->run_time += 1;
+            nd->busy_time += 1;
+            fair_charge(nd, p, 1);
             nd->clock += 1;
             used      += 1;
 
             p->want_dst_addr = op->a;
             p->want_src_addr = 0;
-            p->unblock_time  = 0;
+            p->unblock_time  = op->b ? nd->clock + op->b : 0;
             p->state         = BLOCKED;
-            print_state(nd->node_id, nd->clock, p->node_pid, "blocked (send)");
+            p->rdv_since     = nd->clock;
+            print_state(nd->node_id, nd->clock, p->node_pid, EV_BLOCKED_SEND);
             add_blocked(nd, p);
-            glob_add(p);
-            (void)try_match_now(nd, p);
+            rdv_offer(nd, p);
             yielded = 1;
             break;
         }
         else if (op->type == RECV) {
             // one tick to attempt recv, then block as receiver
             add_wait_ready(nd, 1);
+            if (opt_sample_interval) sample_until(nd, nd->clock + 1, 1);
             p->run_time += 1;          // account for this tick
+            nd->busy_time += 1;
+            fair_charge(nd, p, 1);
             nd->clock += 1;
             used      += 1;
 
             p->want_src_addr = op->a;
             p->want_dst_addr = 0;
-            p->unblock_time  = 0;
+            p->unblock_time  = op->b ? nd->clock + op->b : 0;
             p->state         = BLOCKED;
-            print_state(nd->node_id, nd->clock, p->node_pid, "blocked (recv)");
+            p->rdv_since     = nd->clock;
+            print_state(nd->node_id, nd->clock, p->node_pid, EV_BLOCKED_RECV);
             add_blocked(nd, p);
-            glob_add(p);
-            (void)try_match_now(nd, p);
+            rdv_offer(nd, p);
             yielded = 1;
             break;
         }
 
-        else if (op->type == HALT) {
-            // HALT finishes at current time with zero cost
+        else if (op->type == SPAWN) {
+            // one tick to create the child, parent keeps its slice
+            add_wait_ready(nd, 1);
+            if (opt_sample_interval) sample_until(nd, nd->clock + 1, 1);
+            p->run_time += 1;
+            nd->busy_time += 1;
+            fair_charge(nd, p, 1);
+            nd->clock += 1;
+            used      += 1;
+            spawn_proc(nd, op->b, op->a, nd->clock);
+            p->pc++;
+        }
+        else if (op->type == DEADLINE) {
+            // zero cost, scores the previous segment and opens the next
+            deadline_close(p, nd->clock);
+            p->deadline = nd->clock + op->a;
             p->pc++;
-            p->state = FINISHED;
-            p->finish_time = nd->clock;
-            print_state(nd->node_id, nd->clock, p->node_pid, "finished");
+        }
+        else if (op->type == HALT || op->type == EXIT) {
+            // HALT finishes at current time with zero cost, EXIT also recycles the record
+            proc_finish(nd, p);
             yielded = 1;
             break;
         }
@@ -434,7 +1781,7 @@ static int node_run_timeslice(Node *nd) {
         }
     }
 
-    if (!yielded && p->state != FINISHED && p->pc < p->op_count) {
+    if (!yielded && p->state != FINISHED && proc_has_op(p)) {
         p->wait_time += nd->quantum;
         add_ready(nd, p);
     }
@@ -466,67 +1813,747 @@ static int node_advance_to_next_event(Node *nd) {
 static int any_work_left(void) {
     for (int n = 1; n <= num_nodes; ++n) {
         Node *nd = &nodes[n];
-        if (nd->ready_count > 0)   return 1;
+        if (rq_len(nd) > 0)        return 1;
         if (nd->blocked_count > 0) return 1;
         if (nd->pend_count > 0)    return 1;
     }
     return 0;
 }
 
-/* --------- main --------- */
-int main(void) {
-    // Input header: count of procs, count of nodes, quantum
-    if (scanf("%d %d %d", &total_procs, &num_nodes, &quantum) != 3) return 0;
-
+/* --------- gangs --------- */
+static int uf_find(int *up, int i) {
+    while (up[i] != i) i = up[i] = up[up[i]];
+    return i;
+}
 
+// Group procs whose programs SEND to or RECV from each other, directly or through
+// a chain, and number every group of two or more from one in input order
+// Plugin driven ops are not known ahead and do not join a proc to a gang
+static void gang_assign(void) {
+    int up[MAX_PROCS], size[MAX_PROCS], id[MAX_PROCS];
+    for (int i = 0; i < total_procs; ++i) { up[i] = i; size[i] = 0; id[i] = 0; }
     for (int i = 0; i < total_procs; ++i) {
-        // Read one process line then parse its program
-        char name[32]; int size, prio, node_id;
-        if (scanf("%31s %d %d %d", name, &size, &prio, &node_id) != 4) return 0;
+        Process *p = &proto_procs[i];
+        for (int k = 0; k < p->op_count; ++k) {
+            if (p->ops[k].type != SEND && p->ops[k].type != RECV) continue;
+            int a = p->ops[k].a;
+            for (int j = 0; j < total_procs; ++j) {
+                Process *q = &proto_procs[j];
+                if (j == i || q->node < 1 || proc_addr(q) != a) continue;
+                up[uf_find(up, i)] = uf_find(up, j);
+            }
+        }
+    }
+    for (int i = 0; i < total_procs; ++i) size[uf_find(up, i)]++;
+    gang_count = 0;
+    for (int i = 0; i < total_procs; ++i) {
+        int r = uf_find(up, i);
+        if (size[r] < 2) continue;
+        if (!id[r]) id[r] = ++gang_count;
+        proto_procs[i].gang = id[r];
+    }
+}
 
-        Process *p = &all_procs[i];
-        strcpy(p->name, name);
-        p->size = size; p->priority = prio; p->node = node_id;
-        p->pid_global = i + 1;
-        p->op_count = 0; p->pc = 0;
-        p->state = NEW;
-        p->run_time = p->block_time = p->wait_time = p->finish_time = 0;
-        p->unblock_time = 0;
-        p->sends = p->recvs = 0;
-        p->want_dst_addr = 0; p->want_src_addr = 0;
+/* --------- live metrics --------- */
+// Copy finished processes and the node gauges to the board
+static void metrics_publish_nodes(void) {
+    atomic_store_explicit(&board->procs_finished, sim_finished, memory_order_relaxed);
+    for (int n = 1; n <= num_nodes; ++n) {
+        Node *nd = &nodes[n];
+        MxNode *m = &board->node[n];
+        atomic_store_explicit(&m->clock, nd->clock, memory_order_relaxed);
+        atomic_store_explicit(&m->ready, rq_len(nd), memory_order_relaxed);
+        atomic_store_explicit(&m->blocked, nd->blocked_count, memory_order_relaxed);
+        atomic_store_explicit(&m->pending, nd->pend_count, memory_order_relaxed);
+        atomic_store_explicit(&m->finished, nd->finished_count, memory_order_relaxed);
+    }
+}
+
+// Copy current values to the board, relaxed stores only so the sim never waits
+static void metrics_publish(void) {
+    atomic_store_explicit(&board->events, sim_events, memory_order_relaxed);
+    metrics_publish_nodes();
+}
 
-        p->op_count = 0;
-        p->pc = 0;
-        /* Expand LOOP and END then stop at HALT */
-        parse_block_into(p->ops, &p->op_count, 0);
+// Final values stay on the board until the server goes away
+static void metrics_stop(void) {
+    if (!board) return;
+    atomic_store(&board->running, 0);
+    mx_stop();
+    free(board);
+    board = NULL;
+}
 
+/* --------- run setup --------- */
+// Give this thread its own live state
+static void sim_alloc(void) {
+    if (opt_partitions) {
+        // workers are forked later and must see the same records at the same addresses
+        size_t slabs = (size_t)num_nodes * SLABS_PER_NODE;
+        part_shm_bytes = MAX_PROCS * sizeof(Process) + (MAX_NODES + 1) * sizeof(Node) + slabs * sizeof(Slab);
+        part_shm = shm_alloc(part_shm_bytes);
+        if (!part_shm) { fprintf(stderr, "prosim: cannot map shared memory\n"); exit(1); }
+        all_procs = (Process *)part_shm;
+        nodes     = (Node *)(part_shm + MAX_PROCS * sizeof(Process));
+        Slab *pool = (Slab *)((char *)nodes + (MAX_NODES + 1) * sizeof(Node));
+        for (size_t i = 0; i < slabs; ++i) { pool[i].next = slab_pool; slab_pool = &pool[i]; }
+    } else {
+        all_procs = calloc(MAX_PROCS, sizeof(Process));
+        nodes     = calloc(MAX_NODES + 1, sizeof(Node));
+    }
+    glob_blocked = calloc(MAX_PROCS * MAX_NODES, sizeof(Process *));
+    glob_at = calloc(ADDR_SLOTS, sizeof(Process *));
+    if (!all_procs || !nodes || !glob_blocked || !glob_at) {
+        fprintf(stderr, "prosim: out of memory\n");
+        exit(1);
     }
+    long long b[MEM_COUNT] = { 0 };
+    mem_sim_state(b);
+    mem_add_all(b, 1);
+    perf_begin();
+}
 
-    // Init nodes then place procs into node bins
+static void sim_free(void) {
+    perf_end();
+    for (int n = 1; n <= num_nodes; ++n) slab_free_all(&nodes[n]);
+    long long b[MEM_COUNT] = { 0 };
+    mem_sim_state(b);
+    mem_add_all(b, -1);
+    if (part_shm) {
+        shm_free(part_shm, part_shm_bytes);
+        part_shm = NULL;
+        slab_pool = NULL;
+    } else {
+        free(all_procs);
+        free(nodes);
+    }
+    all_procs = NULL;
+    nodes = NULL;
+    free(glob_blocked); glob_blocked = NULL;
+    free(glob_at); glob_at = NULL;
+}
+
+// Copy the parsed workload into live state and draw random operands from seed
+static void sim_reset(uint64_t seed) {
     for (int n = 1; n <= num_nodes; ++n) {
         nodes[n].node_id = n;
         nodes[n].quantum = quantum;
         nodes[n].clock = 0;
         nodes[n].proc_count = 0;
         nodes[n].ready_count = nodes[n].blocked_count = nodes[n].pend_count = 0;
+        nodes[n].comm_count = nodes[n].comm_streak = 0;
+        nodes[n].busy_time = nodes[n].dispatches = nodes[n].messages = 0;
+        nodes[n].next_sample = 0;
+        slab_free_all(&nodes[n]);
+        memset(nodes[n].pid_used, 0, sizeof nodes[n].pid_used);
+        nodes[n].spawned = nodes[n].exited = nodes[n].spawn_failed = 0;
+        nodes[n].exited_run = nodes[n].exited_block = nodes[n].exited_wait = 0;
+        nodes[n].last_finish = 0;
+        nodes[n].exited_missed = 0;
+        nodes[n].timeouts = 0;
+        nodes[n].rq_seq = 0;
+        nodes[n].min_vruntime = 0;
+        memset(nodes[n].tickets, 0, sizeof nodes[n].tickets);
+        memset(nodes[n].lot_proc, 0, sizeof nodes[n].lot_proc);
+        nodes[n].lot_rng = seed ^ ((uint64_t)n << 48) ^ 0x5851f42d4c957f2dULL;
+        nodes[n].finished_count = 0;
+        nodes[n].rdv_wait = 0;
+        nodes[n].rendezvous = 0;
+        nodes[n].chain_msgs = nodes[n].chain_max = 0;
+        nodes[n].chain_sum = 0;
+        nodes[n].faults_done = nodes[n].down_from = nodes[n].down_until = 0;
+        nodes[n].crashes = nodes[n].crash_procs = nodes[n].restarts = 0;
+        nodes[n].lost = nodes[n].rdv_failed = 0;
     }
-    int node_counts[MAX_NODES + 1] = {0};
+    glob_blocked_count = 0;
+    glob_head = glob_tail = NULL;
+    memset(glob_at, 0, ADDR_SLOTS * sizeof *glob_at);
+    sim_seed = seed;
+    spawn_seq = 0;
+    sim_events = 0;
+    sim_finished = 0;
+
     for (int i = 0; i < total_procs; ++i) {
-        int n = all_procs[i].node;
-        nodes[n].procs[nodes[n].proc_count++] = &all_procs[i];
-        all_procs[i].node_pid = ++node_counts[n];
+        Process *p = &all_procs[i];
+        *p = proto_procs[i];
+        // independent stream per process so draws do not depend on schedule
+        p->rng = seed ^ ((uint64_t)p->pid_global << 32);
+        (void)rng_next(&p->rng);
+        uint64_t alt = p->rng ^ 0xd1b54a32d192ed03ULL;   // leaves operand draws untouched
+        p->ctx.seed = rng_next(&alt);
+        draw_ops(p);
+        if (p->node == 0) continue;   // SPAWN template, never started itself
+        deadline_arrive(p, 0);
+        Node *nd = &nodes[p->node];
+        nd->procs[nd->proc_count++] = p;
+        if (p->node_pid < 128) mask_set(nd->pid_used, p->node_pid);
     }
+}
 
-    // Time zero log of NEW then mark all as READY
+/* --------- checkpoints --------- */
+/* With --checkpoint DIR the run saves its whole state every few ticks as
+ * KEY.ckpt, with the trace lines printed since the previous one as
+ * KEY.trace. KEY hashes everything the state could depend on: the
+ * options that steer the engine, each proc header, and for each proto
+ * only the leading ops some copy of it has reached. A later run with an
+ * edited workload recomputes KEY for every saved reach; the checkpoints
+ * that still match sit before the first point the edit could change, so
+ * the run prints the saved trace up to the latest of them and goes on
+ * from its state. Pointers are saved as record numbers, all_procs first
+ * and then every node's slabs in list order.
+ */
+#define CKPT_MAGIC 0x54504b43u   // "CKPT"
+
+typedef struct {
+    uint32_t magic;
+    int procs;                 // total_procs, entries of reach in use
+    uint64_t key, prev;        // this checkpoint and the one before it, zero for none
+    int step, tick;            // place in the chain, max clock when saved
+    int reach[MAX_PROCS];
+} CkptHead;
+
+static uint64_t ckpt_prev;     // last checkpoint written or resumed from
+static int ckpt_step;
+static int sim_resumed;        // state came from a checkpoint, skip the time zero setup
+
+#define FOLD(x) (h = store_hash(h, &(x), sizeof(x)))
+
+// Hash of the bytes of the shared object at path, read once per library, so
+// a rebuilt plugin never matches what the old one produced
+static uint64_t plugin_file_hash(const char *path) {
+    static struct { char *path; uint64_t h; } seen[16];
+    static int seen_count;
+    for (int i = 0; i < seen_count; ++i)
+        if (strcmp(seen[i].path, path) == 0) return seen[i].h;
+    uint64_t h = STORE_HASH_INIT;
+    FILE *f = fopen(path, "rb");
+    if (f) {
+        char buf[65536];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof buf, f)) > 0) h = store_hash(h, buf, n);
+        fclose(f);
+    }
+    if (seen_count < 16 && (seen[seen_count].path = strdup(path))) seen[seen_count++].h = h;
+    return h;
+}
+
+// Fold the parsed workload into h, the leading reach[i] ops of proto i or all of
+// them when reach is NULL, so layout and LOOP spelling in the input do not count
+static uint64_t hash_workload(uint64_t h, const int *reach) {
+    FOLD(total_procs); FOLD(num_nodes); FOLD(quantum);
+    for (int i = 0; i < total_procs; ++i) {
+        const Process *p = &proto_procs[i];
+        int r = reach ? reach[i] : p->op_count;
+        // gangs and chain sinks come from the whole program
+        int gang = opt_sched == POLICY_GANG ? p->gang : 0;
+        int whole = r == p->op_count ? p->op_count : -1;
+        h = store_hash(h, p->name, strlen(p->name) + 1);
+        FOLD(p->size); FOLD(p->priority); FOLD(p->node); FOLD(p->node_pid);
+        FOLD(p->chain_sink); FOLD(gang); FOLD(r); FOLD(whole);
+        for (int k = 0; k < r; ++k) {
+            const Operation *op = &p->ops[k];
+            FOLD(op->type); FOLD(op->a); FOLD(op->b); FOLD(op->dist); FOLD(op->d1); FOLD(op->d2);
+        }
+        Dl_info dl;
+        if (p->behavior && dladdr((void *)p->behavior, &dl)) {
+            uint64_t lib = plugin_file_hash(dl.dli_fname);
+            h = store_hash(h, dl.dli_fname, strlen(dl.dli_fname) + 1);
+            FOLD(lib);
+            if (dl.dli_sname) h = store_hash(h, dl.dli_sname, strlen(dl.dli_sname) + 1);
+            h = store_hash(h, p->ctx.arg, strlen(p->ctx.arg) + 1);
+        }
+    }
+    return h;
+}
+
+// Options that change what a run prints, the seed only when seeded is set
+static uint64_t hash_options(uint64_t h, int seeded) {
+    int sched = opt_sched;
+    if (seeded) FOLD(opt_seed);
+    int policy = opt_fault_policy;
+    FOLD(sched); FOLD(opt_comm_boost);
+    FOLD(fault_count); FOLD(faults); FOLD(policy);
+    FOLD(trace_nodes); FOLD(trace_pids); FOLD(trace_events); FOLD(trace_t_lo); FOLD(trace_t_hi);
+    return h;
+}
+
+// Key of the state a run has at the first step its max clock reaches tick, having
+// looked at reach[i] leading ops of proto i by then
+static uint64_t ckpt_key(const int *reach, int tick) {
+    uint64_t h = STORE_HASH_INIT;
+    int layout[] = { (int)sizeof(Process), (int)sizeof(Node), MAX_PROCS, MAX_OPS };
+    FOLD(tick); FOLD(layout); FOLD(opt_reference);
+    h = hash_workload(hash_options(h, 1), reach);
+    return h ? h : 1;   // zero means no checkpoint
+}
+
+// Record number of p, zero for NULL and for anything that is not a record
+static uintptr_t ckpt_id(const Process *p) {
+    if (!p) return 0;
+    if (p >= all_procs && p < all_procs + MAX_PROCS) return 1 + (uintptr_t)(p - all_procs);
+    uintptr_t base = 1 + MAX_PROCS;
+    for (int n = 1; n <= num_nodes; ++n)
+        for (Slab *sl = nodes[n].slabs; sl; sl = sl->next, base += SLAB_PROCS)
+            if (p >= sl->recs && p < sl->recs + SLAB_PROCS) return base + (uintptr_t)(p - sl->recs);
+    return 0;
+}
+
+static void ckpt_ids(Process **v, int n) {
+    for (int i = 0; i < n; ++i) v[i] = (Process *)ckpt_id(v[i]);
+}
+
+// Record for each number, filled once the slabs exist again
+static Process **ckpt_recs;
+static uintptr_t ckpt_rec_count;
+
+static void ckpt_ptrs(Process **v, int n) {
+    for (int i = 0; i < n; ++i) {
+        uintptr_t id = (uintptr_t)v[i];
+        v[i] = id && id <= ckpt_rec_count ? ckpt_recs[id - 1] : NULL;
+    }
+}
+
+static void ckpt_node_ids(Node *nd) {
+    ckpt_ids(nd->procs, MAX_PROCS);
+    ckpt_ids(nd->ready, MAX_PROCS);
+    ckpt_ids(nd->comm, MAX_PROCS);
+    ckpt_ids(nd->blocked, MAX_PROCS);
+    ckpt_ids(nd->lot_proc, LOT_SLOTS + 1);
+    ckpt_ids(&nd->free_procs, 1);
+    for (int i = 0; i < nd->pend_count; ++i) ckpt_ids(&nd->pend[i].p, 1);
+    nd->slabs = NULL;
+}
+
+static void ckpt_node_ptrs(Node *nd) {
+    ckpt_ptrs(nd->procs, MAX_PROCS);
+    ckpt_ptrs(nd->ready, MAX_PROCS);
+    ckpt_ptrs(nd->comm, MAX_PROCS);
+    ckpt_ptrs(nd->blocked, MAX_PROCS);
+    ckpt_ptrs(nd->lot_proc, LOT_SLOTS + 1);
+    ckpt_ptrs(&nd->free_procs, 1);
+    for (int i = 0; i < nd->pend_count; ++i) ckpt_ptrs(&nd->pend[i].p, 1);
+}
+
+static void ckpt_proc_out(Buf *b, const Process *p) {
+    Process c = *p;
+    ckpt_ids(&c.next_free, 1);
+    ckpt_ids(&c.glob_prev, 1);
+    ckpt_ids(&c.glob_next, 1);
+    c.behavior = c.behavior ? (ps_behavior)1 : NULL;   // only whether it still asks the plugin
+    c.ctx.arg = NULL;
+    buf_add(b, &c, sizeof c);
+}
+
+static int ckpt_max_clock(void) {
+    int t = 0;
+    for (int n = 1; n <= num_nodes; ++n) if (nodes[n].clock > t) t = nodes[n].clock;
+    return t;
+}
+
+// Save the state between two engine steps, the key covers what it depends on
+static void ckpt_save(void) {
+    for (int n = 1; n <= num_nodes; ++n)
+        for (int i = 0; i < nodes[n].proc_count; ++i) ckpt_touch(nodes[n].procs[i]);
+
+    Buf b = { 0 };
+    int tick = ckpt_max_clock();
+    CkptHead head = { CKPT_MAGIC, total_procs, ckpt_key(ckpt_reach, tick), ckpt_prev, ckpt_step + 1, tick };
+    memcpy(head.reach, ckpt_reach, sizeof head.reach);
+    buf_add(&b, &head, sizeof head);
+
+    int slabs[MAX_NODES + 1] = { 0 };
+    for (int n = 1; n <= num_nodes; ++n)
+        for (Slab *sl = nodes[n].slabs; sl; sl = sl->next) slabs[n]++;
+    buf_add(&b, slabs, sizeof slabs);
+    buf_add(&b, &sim_seed, sizeof sim_seed);
+    buf_add(&b, &spawn_seq, sizeof spawn_seq);
+    buf_add(&b, &sim_events, sizeof sim_events);
+    buf_add(&b, &sim_finished, sizeof sim_finished);
     for (int n = 1; n <= num_nodes; ++n) {
+        Node c = nodes[n];
+        ckpt_node_ids(&c);
+        buf_add(&b, &c, sizeof c);
+    }
+    for (int i = 0; i < total_procs; ++i) ckpt_proc_out(&b, &all_procs[i]);
+    for (int n = 1; n <= num_nodes; ++n)
+        for (Slab *sl = nodes[n].slabs; sl; sl = sl->next)
+            for (int i = 0; i < SLAB_PROCS; ++i) ckpt_proc_out(&b, &sl->recs[i]);
+    // blocked procs, the fast engine in list order, the reference one in array order
+    buf_add(&b, &glob_blocked_count, sizeof glob_blocked_count);
+    if (opt_reference) {
+        for (int i = 0; i < glob_blocked_count; ++i) {
+            uintptr_t id = ckpt_id(glob_blocked[i]);
+            buf_add(&b, &id, sizeof id);
+        }
+    } else {
+        for (Process *p = glob_head; p; p = p->glob_next) {
+            uintptr_t id = ckpt_id(p);
+            buf_add(&b, &id, sizeof id);
+        }
+    }
+
+    if (store_put(opt_checkpoint, ".trace", head.key, ckpt_seg.p ? ckpt_seg.p : "", ckpt_seg.len) != 0
+        || store_put(opt_checkpoint, ".ckpt", head.key, b.p, b.len) != 0) {
+        fprintf(stderr, "prosim: cannot write a checkpoint to %s\n", opt_checkpoint);
+        exit(1);
+    }
+    mem_add(MEM_OUTPUT, -(long long)b.cap);
+    free(b.p);
+    ckpt_seg.len = 0;
+    ckpt_prev = head.key;
+    ckpt_step = head.step;
+    mem_report("checkpoint");
+}
+
+// Called between engine steps, saves once the max clock passes the next mark
+static void ckpt_maybe(void) {
+    int t = ckpt_max_clock();
+    if (t < ckpt_next) return;
+    ckpt_save();
+    ckpt_next = (t / opt_checkpoint_every + 1) * opt_checkpoint_every;
+}
+
+// Load the state after sim_reset, ops past the saved reach come from this workload
+static int ckpt_load(const char *d, size_t len) {
+    const CkptHead *head = (const CkptHead *)d;
+    size_t at = sizeof *head;
+#define TAKE(x) do { if (at + sizeof(x) > len) return -1; memcpy(&(x), d + at, sizeof(x)); at += sizeof(x); } while (0)
+    int slabs[MAX_NODES + 1];
+    TAKE(slabs);
+    TAKE(sim_seed); TAKE(spawn_seq); TAKE(sim_events); TAKE(sim_finished);
+
+    ckpt_rec_count = MAX_PROCS;
+    for (int n = 1; n <= num_nodes; ++n) {
+        for (int i = 0; i < slabs[n]; ++i) slab_grow(&nodes[n]);
+        ckpt_rec_count += (uintptr_t)slabs[n] * SLAB_PROCS;
+    }
+    ckpt_recs = malloc(ckpt_rec_count * sizeof *ckpt_recs);
+    if (!ckpt_recs) { fprintf(stderr, "prosim: out of memory\n"); exit(1); }
+    uintptr_t r = 0;
+    for (int i = 0; i < MAX_PROCS; ++i) ckpt_recs[r++] = &all_procs[i];
+    for (int n = 1; n <= num_nodes; ++n)
+        for (Slab *sl = nodes[n].slabs; sl; sl = sl->next)
+            for (int i = 0; i < SLAB_PROCS; ++i) ckpt_recs[r++] = &sl->recs[i];
+
+    for (int n = 1; n <= num_nodes; ++n) {
+        Slab *keep = nodes[n].slabs;
+        TAKE(nodes[n]);
+        nodes[n].slabs = keep;
+        ckpt_node_ptrs(&nodes[n]);
+    }
+    for (uintptr_t i = 0; i < ckpt_rec_count; ++i) {
+        if (i >= (uintptr_t)total_procs && i < MAX_PROCS) continue;   // all_procs past the workload
+        Process *p = ckpt_recs[i];
+        TAKE(*p);
+        ckpt_ptrs(&p->next_free, 1);
+        ckpt_ptrs(&p->glob_prev, 1);
+        ckpt_ptrs(&p->glob_next, 1);
+        // slab records never handed out hold whatever malloc left there
+        const Process *t = p->proto >= 0 && p->proto < total_procs ? &proto_procs[p->proto] : NULL;
+        p->behavior = p->behavior && t ? t->behavior : NULL;
+        p->ctx.arg = t ? t->ctx.arg : NULL;
+    }
+    int count;
+    TAKE(count);
+    glob_blocked_count = 0;
+    glob_head = glob_tail = NULL;
+    memset(glob_at, 0, ADDR_SLOTS * sizeof *glob_at);
+    for (int i = 0; i < count; ++i) {
+        uintptr_t id;
+        TAKE(id);
+        Process *p = (Process *)id;
+        ckpt_ptrs(&p, 1);
+        if (!p) return -1;
+        glob_add(p);
+    }
+#undef TAKE
+    free(ckpt_recs);
+    ckpt_recs = NULL;
+
+    // ops nobody has reached yet may have changed, draw them as a fresh run would
+    for (int n = 1; n <= num_nodes; ++n) {
+        for (int i = 0; i < nodes[n].proc_count; ++i) {
+            Process *p = nodes[n].procs[i];
+            const Process *t = &proto_procs[p->proto];
+            if (t->behavior) continue;
+            Process fresh = *t;
+            fresh.rng = sim_seed ^ ((uint64_t)p->pid_global << 32);
+            (void)rng_next(&fresh.rng);
+            draw_ops(&fresh);
+            for (int k = head->reach[p->proto]; k < fresh.op_count; ++k) p->ops[k] = fresh.ops[k];
+            p->op_count = fresh.op_count;
+            p->rng = fresh.rng;
+        }
+    }
+    return 0;
+}
+
+// Print the saved trace from the first checkpoint of the chain up to key
+static int ckpt_trace(uint64_t key) {
+    CkptHead head;
+    if (store_read(opt_checkpoint, ".ckpt", key, &head, sizeof head) != (long)sizeof head) return -1;
+    if (head.prev && (head.prev == key || ckpt_trace(head.prev) != 0)) return -1;
+    size_t len;
+    char *seg = store_get(opt_checkpoint, ".trace", key, &len);
+    if (!seg) return -1;
+    fwrite(seg, 1, len, stdout);
+    free(seg);
+    return 0;
+}
+
+// Go on from the latest checkpoint this workload still matches, if any
+static void ckpt_resume(void) {
+    if (store_open(opt_checkpoint) != 0) {
+        fprintf(stderr, "prosim: cannot use %s for checkpoints\n", opt_checkpoint);
+        exit(1);
+    }
+    ckpt_next = opt_checkpoint_every;
+    int n;
+    uint64_t *keys = store_keys(opt_checkpoint, ".ckpt", &n);
+    CkptHead best = { 0 };
+    for (int i = 0; i < n; ++i) {
+        CkptHead head;
+        if (store_read(opt_checkpoint, ".ckpt", keys[i], &head, sizeof head) != (long)sizeof head) continue;
+        if (head.magic != CKPT_MAGIC || head.procs != total_procs || head.key != keys[i]) continue;
+        int bad = 0;
+        for (int k = 0; k < total_procs; ++k)
+            bad |= head.reach[k] < 0 || head.reach[k] > proto_procs[k].op_count;
+        if (bad || ckpt_key(head.reach, head.tick) != head.key) continue;
+        if (head.step > best.step || (head.step == best.step && head.tick > best.tick)) best = head;
+    }
+    free(keys);
+    if (!best.key) {
+        fprintf(stderr, "| Checkpoint | none matches in %s, running from tick 0\n", opt_checkpoint);
+        return;
+    }
+
+    size_t len;
+    char *d = store_get(opt_checkpoint, ".ckpt", best.key, &len);
+    fflush(stdout);
+    if (!d || ckpt_trace(best.key) != 0 || ckpt_load(d, len) != 0) {
+        fprintf(stderr, "prosim: checkpoint %016llx in %s is damaged\n",
+                (unsigned long long)best.key, opt_checkpoint);
+        exit(1);
+    }
+    free(d);
+    memcpy(ckpt_reach, best.reach, sizeof ckpt_reach);
+    ckpt_prev = best.key;
+    ckpt_step = best.step;
+    ckpt_next = (best.tick / opt_checkpoint_every + 1) * opt_checkpoint_every;
+    sim_resumed = 1;
+    fprintf(stderr, "| Checkpoint | resumed at tick %d from %s/%016llx.ckpt\n",
+            best.tick, opt_checkpoint, (unsigned long long)best.key);
+}
+
+/* --------- partitions --------- */
+/* Worker processes own contiguous ranges of nodes and run the node local
+ * part of each engine step (flush, expire, one time slice) in parallel.
+ * Whatever would touch another node or global order, i.e. trace lines,
+ * rendezvous offers, spawns and pid releases, goes to the coordinator as a
+ * message. After every worker is done the coordinator applies the messages
+ * sorted by step phase and node, which is exactly the order the serial
+ * loop would have done them in, so output matches a run without partitions.
+ */
+#define PART_RING 4096
+
+typedef struct { ShmMsg *m; int len, cap, at; } Inbox;
+
+static int part_count;       // workers running, zero outside a partitioned run
+static pid_t *part_pid;
+static ShmCtl *part_ctl;     // shared, one per worker
+static ShmRing **part_ring;
+static Inbox *part_inbox;
+static uint32_t part_seq;     // engine steps so far
+static long long part_cpu0;   // coordinator cpu at start
+
+// Worker that owns node n
+static int part_of(int n) {
+    return (int)((long long)(n - 1) * part_count / num_nodes);
+}
+
+// One engine step over the nodes of worker w, in this worker process
+static int part_work(int w) {
+    int progress = 0;
+    part_phase = PH_FLUSH;
+    for (int n = 1; n <= num_nodes; ++n) if (part_of(n) == w) progress |= node_flush_pending(&nodes[n]);
+    part_phase = PH_EXPIRE;
+    for (int n = 1; n <= num_nodes; ++n) if (part_of(n) == w) progress |= node_expire_block(&nodes[n]);
+    part_phase = PH_RUN;
+    for (int n = 1; n <= num_nodes; ++n) if (part_of(n) == w) progress |= node_run_timeslice(&nodes[n]);
+    return progress;
+}
+
+static long long cpu_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Sleeps on its go word between the steps it is given, idle steps never wake it
+static void part_worker(int w) {
+    part_out = part_ring[w];
+    for (uint32_t seq = 1;; ++seq) {
+        shm_wait(&part_ctl[w].go, seq);
+        if (atomic_load(&part_ctl[w].quit)) _exit(0);
+        part_ctl[w].progress = part_work(w);
+        part_ctl[w].steps++;
+        part_ctl[w].cpu_ns = cpu_now_ns();
+        shm_post(&part_ctl[w].done, seq);
+    }
+}
+
+// Would a step change anything on nd, the same tests flush, expire and run make
+static int node_due(const Node *nd) {
+    if (rq_len(nd) > 0) return 1;
+    for (int i = 0; i < nd->pend_count; ++i) if (nd->pend[i].due_time <= nd->clock) return 1;
+    for (int i = 0; i < nd->blocked_count; ++i) {
+        const Process *p = nd->blocked[i];
+        if (p->unblock_time > 0 && nd->clock >= p->unblock_time) return 1;
+    }
+    return 0;
+}
+
+// Proc with node pid pid on nd, messages name procs by id only
+static Process *part_proc(Node *nd, int pid) {
+    for (int i = 0; i < nd->proc_count; ++i)
+        if (nd->procs[i]->node_pid == pid) return nd->procs[i];
+    fprintf(stderr, "prosim: partition message for unknown proc %d on node %d\n", pid, nd->node_id);
+    exit(1);
+}
+
+static void part_apply(const ShmMsg *m) {
+    Node *nd = &nodes[m->node];
+    switch (m->kind) {
+    case MSG_STATE:   print_state(m->node, m->a, m->b, (Event)m->c); break;
+    case MSG_RDV:     rdv_offer(nd, part_proc(nd, m->a)); break;
+    case MSG_SPAWN:   spawn_proc(nd, m->a, m->b, m->c); break;
+    case MSG_RELEASE: proc_release(nd, part_proc(nd, m->a)); break;
+    case MSG_GIVEUP:  glob_remove(part_proc(nd, m->a)); break;
+    }
+}
+
+// Move what worker w has sent so far into its inbox
+static void part_drain(int w) {
+    Inbox *in = &part_inbox[w];
+    ShmMsg m;
+    while (ring_pop(part_ring[w], &m)) {
+        if (in->len == in->cap) {
+            in->cap = in->cap ? in->cap * 2 : 1024;
+            in->m = realloc(in->m, in->cap * sizeof *in->m);
+            if (!in->m) { fprintf(stderr, "prosim: out of memory\n"); exit(1); }
+        }
+        in->m[in->len++] = m;
+    }
+}
+
+// Steps one to three of the engine loop across the workers
+static int part_step(void) {
+    ++part_seq;
+    // a worker whose nodes have nothing due stays parked, its step would be empty
+    int posted[part_count];
+    for (int w = 0; w < part_count; ++w) posted[w] = 0;
+    for (int n = 1; n <= num_nodes; ++n) if (!posted[part_of(n)] && node_due(&nodes[n])) posted[part_of(n)] = 1;
+    for (int w = 0; w < part_count; ++w)
+        if (posted[w]) shm_post(&part_ctl[w].go, atomic_load(&part_ctl[w].go) + 1);
+
+    // keep the rings moving until every posted worker reports the step done
+    int progress = 0;
+    for (int w = 0; w < part_count; ++w) {
+        if (!posted[w]) continue;
+        uint32_t want = atomic_load(&part_ctl[w].go);
+        while (!shm_wait_for(&part_ctl[w].done, want, 100000)) {
+            for (int v = 0; v < part_count; ++v) part_drain(v);
+            if (waitpid(part_pid[w], NULL, WNOHANG) == part_pid[w]) {
+                fprintf(stderr, "prosim: partition worker %d died\n", w);
+                exit(1);
+            }
+        }
+        progress |= part_ctl[w].progress;
+    }
+    for (int w = 0; w < part_count; ++w) part_drain(w);
+
+    // workers send in phase then node order, replay merges them the same way
+    for (int ph = PH_FLUSH; ph <= PH_RUN; ++ph) {
+        for (int n = 1; n <= num_nodes; ++n) {
+            Inbox *in = &part_inbox[part_of(n)];
+            while (in->at < in->len && in->m[in->at].phase == ph && in->m[in->at].node == n)
+                part_apply(&in->m[in->at++]);
+        }
+    }
+    for (int w = 0; w < part_count; ++w) part_inbox[w].len = part_inbox[w].at = 0;
+    return progress;
+}
+
+// Fork the workers for the run that sim_reset just prepared
+static void part_start(int count) {
+    if (count > num_nodes) count = num_nodes;
+    part_pid = calloc(count, sizeof *part_pid);
+    part_ring = calloc(count, sizeof *part_ring);
+    part_inbox = calloc(count, sizeof *part_inbox);
+    part_ctl = shm_alloc(count * sizeof *part_ctl);
+    if (!part_pid || !part_ring || !part_inbox || !part_ctl) { fprintf(stderr, "prosim: out of memory\n"); exit(1); }
+    part_count = count;
+    part_seq = 0;
+    part_cpu0 = cpu_now_ns();
+    for (int w = 0; w < count; ++w)
+        if (!(part_ring[w] = ring_new(PART_RING))) { fprintf(stderr, "prosim: cannot map shared memory\n"); exit(1); }
+    fflush(NULL);   // children must not write out a copy of buffered output
+    for (int w = 0; w < count; ++w) {
+        part_pid[w] = fork();
+        if (part_pid[w] < 0) { fprintf(stderr, "prosim: cannot fork\n"); exit(1); }
+        if (part_pid[w] == 0) part_worker(w);
+    }
+}
+
+// Cpu each process spent against the simulated work of its nodes, on stderr
+static void part_report(void) {
+    for (int w = 0; w < part_count; ++w) {
+        int lo = 0, hi = 0;
+        long long busy = 0;
+        for (int n = 1; n <= num_nodes; ++n) {
+            if (part_of(n) != w) continue;
+            if (!lo) lo = n;
+            hi = n;
+            busy += nodes[n].busy_time;
+        }
+        const ShmCtl *c = &part_ctl[w];
+        double ms = c->cpu_ns / 1e6;
+        fprintf(stderr, "| Partition %d | nodes %d-%d | steps %d of %u, parked %.1f%% | cpu %.1f ms"
+                        " | busy %lld ticks, %.0f ticks per cpu ms\n",
+                w, lo, hi, c->steps, part_seq, part_seq ? 100.0 * (part_seq - c->steps) / part_seq : 0.0,
+                ms, busy, ms > 0 ? busy / ms : 0.0);
+    }
+    fprintf(stderr, "| Coordinator | steps %u | cpu %.1f ms\n", part_seq, (cpu_now_ns() - part_cpu0) / 1e6);
+}
+
+static void part_stop(void) {
+    if (opt_part_stats) part_report();
+    for (int w = 0; w < part_count; ++w) {
+        atomic_store(&part_ctl[w].quit, 1);
+        shm_post(&part_ctl[w].go, atomic_load(&part_ctl[w].go) + 1);
+    }
+    for (int w = 0; w < part_count; ++w) {
+        waitpid(part_pid[w], NULL, 0);
+        ring_free(part_ring[w]);
+        free(part_inbox[w].m);
+    }
+    shm_free(part_ctl, part_count * sizeof *part_ctl);
+    free(part_pid); free(part_ring); free(part_inbox);
+    part_count = 0;
+}
+
+// Run the loaded workload until every node has drained
+static void sim_run(void) {
+    // Time zero log of NEW then mark all as READY, a resumed run is past that
+    for (int n = 1; n <= num_nodes && !sim_resumed; ++n) {
         Node *nd = &nodes[n];
         for (int i = 0; i < nd->proc_count; ++i) {
             Process *p = nd->procs[i];
             p->state = NEW;
-            print_state(n, nd->clock, p->node_pid, "new");
+            print_state(n, nd->clock, p->node_pid, EV_NEW);
         }
     }
-    for (int n = 1; n <= num_nodes; ++n) {
+    for (int n = 1; n <= num_nodes && !sim_resumed; ++n) {
         Node *nd = &nodes[n];
         for (int i = 0; i < nd->proc_count; ++i) add_ready(nd, nd->procs[i]);
     }
@@ -534,15 +2561,27 @@ int main(void) {
     // Main loop for all nodes using single logical time
     while (any_work_left()) {
         int progress = 0;
+        if (ckpt_next) ckpt_maybe();
+        if (fault_count) fault_check();
 
-        // step one flush pending items that are due now
-        for (int n = 1; n <= num_nodes; ++n) progress |= node_flush_pending(&nodes[n]);
-        // step two expire timed BLOCKs if ready now
-        for (int n = 1; n <= num_nodes; ++n) progress |= node_expire_block(&nodes[n]);
-        // step three run one time slice per node in id order
-        for (int n = 1; n <= num_nodes; ++n) progress |= node_run_timeslice(&nodes[n]);
+        if (part_count) {
+            progress = part_step();
+        } else {
+            // step one flush pending items that are due now
+            perf_enter(PH_FLUSH);
+            for (int n = 1; n <= num_nodes; ++n) progress |= node_flush_pending(&nodes[n]);
+            // step two expire timed BLOCKs if ready now
+            perf_enter(PH_EXPIRE);
+            for (int n = 1; n <= num_nodes; ++n) progress |= node_expire_block(&nodes[n]);
+            // step three run one time slice per node in id order
+            perf_enter(PH_RUN);
+            for (int n = 1; n <= num_nodes; ++n) progress |= node_run_timeslice(&nodes[n]);
+        }
         // step four try to create a SEND or RECV match if all nodes yielded
+        perf_enter(PH_MATCH);
         if (!progress) progress |= sweep_global_matches();
+        perf_enter(PH_OTHER);
+        if (board_owner) metrics_publish();
 
         // step five if still stuck jump one node to next event
         if (!progress) {
@@ -556,9 +2595,13 @@ int main(void) {
                     Process *p = nd->blocked[i];
                     if (p->unblock_time > nd->clock && p->unblock_time < t) { t = p->unblock_time; has = 1; }
                 }
+                // a crash can release what is blocked here for good
+                int f = fault_count && nd->blocked_count ? fault_next(nd) : 0x3fffffff;
+                if (f > nd->clock && f < t) { t = f; has = 1; }
                 if (has && t < best_time) { best_time = t; best_node = n; }
             }
             if (best_node != -1) {
+                if (opt_sample_interval) sample_until(&nodes[best_node], best_time, 0);
                 nodes[best_node].clock = best_time;
                 // do not flush now, next loop pass will handle it
                 progress = 1;
@@ -570,34 +2613,985 @@ int main(void) {
 
     }
 
-    // Build summary rows then print sorted by finish time and tie breaks
-    typedef struct { Process *p; int finish, node_id, node_pid, key; } Row;
-    Row rows[MAX_PROCS * MAX_NODES]; int rc = 0;
+    // Close the series on every node at the last clock reached anywhere
+    if (opt_sample_interval) {
+        int end = 0;
+        for (int n = 1; n <= num_nodes; ++n) if (nodes[n].clock > end) end = nodes[n].clock;
+        for (int n = 1; n <= num_nodes; ++n) sample_until(&nodes[n], end + 1, 0);
+    }
+}
+
+/* --------- policy comparison --------- */
+// Totals a policy is judged by, read from the finished run in this thread
+typedef struct {
+    long long rdv_wait;
+    int rendezvous;
+    long long chain_sum;
+    int chain_msgs, chain_max;
+} RunTotals;
+
+static RunTotals baseline;        // same workload and seed under plain round robin
+static int have_baseline = 0;
+
+static RunTotals run_totals(void) {
+    RunTotals t = { 0 };
+    for (int n = 1; n <= num_nodes; ++n) {
+        t.rdv_wait += nodes[n].rdv_wait;
+        t.rendezvous += nodes[n].rendezvous;
+        t.chain_sum += nodes[n].chain_sum;
+        t.chain_msgs += nodes[n].chain_msgs;
+        if (nodes[n].chain_max > t.chain_max) t.chain_max = nodes[n].chain_max;
+    }
+    return t;
+}
+
+// Run the workload once under round robin without boost, trace or samples
+// Call before the real run, which then replaces the thread's sim state
+static void run_baseline(void) {
+    Policy keep = opt_sched;
+    int boost = opt_comm_boost;
+    uint32_t events = trace_events;
+    int interval = opt_sample_interval;
+    opt_sched = POLICY_RR;
+    opt_comm_boost = 0;
+    trace_filter_none();
+    opt_sample_interval = 0;
+
+    sim_reset(opt_seed);
+    sim_run();
+    baseline = run_totals();
+    have_baseline = 1;
+
+    opt_sched = keep;
+    opt_comm_boost = boost;
+    trace_events = events;
+    opt_sample_interval = interval;
+}
+
+// Latest finish on any node of the finished run in this thread
+static int run_makespan(void) {
+    int makespan = 0;
+    for (int n = 1; n <= num_nodes; ++n)
+        if (nodes[n].last_finish > makespan) makespan = nodes[n].last_finish;
+    return makespan;
+}
+
+static int faultless_makespan;    // same workload and seed with no --fault
+static int have_faultless = 0;
+
+// Run the workload once without faults, trace or samples, before the real run
+static void run_faultless(void) {
+    int count = fault_count;
+    uint32_t events = trace_events;
+    int interval = opt_sample_interval;
+    fault_count = 0;
+    trace_filter_none();
+    opt_sample_interval = 0;
+
+    sim_reset(opt_seed);
+    sim_run();
+    faultless_makespan = run_makespan();
+    have_faultless = 1;
+
+    fault_count = count;
+    trace_events = events;
+    opt_sample_interval = interval;
+}
+
+// Policy in force as the summary names it, e.g. fair+boost
+static const char *policy_label(void) {
+    static char label[32];
+    snprintf(label, sizeof label, "%s%s", policy_name[opt_sched], opt_comm_boost ? "+boost" : "");
+    return label;
+}
+
+// Percent change of x against base, zero when there is no base
+static double pct_change(double x, double base) {
+    return base > 0 ? 100.0 * (x - base) / base : 0.0;
+}
+
+/* --------- summary --------- */
+// Process name as a quoted CSV field
+static void buf_csv_str(Buf *b, const char *s) {
+    buf_printf(b, "\"");
+    for (; *s; ++s) buf_printf(b, *s == '"' ? "\"\"" : "%c", *s);
+    buf_printf(b, "\"");
+}
+
+// Process name as a JSON string
+static void buf_json_str(Buf *b, const char *s) {
+    buf_printf(b, "\"");
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') buf_printf(b, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20) buf_printf(b, "\\u%04x", *s);
+        else buf_printf(b, "%c", *s);
+    }
+    buf_printf(b, "\"");
+}
+
+static const char *state_name(State s) {
+    switch (s) {
+    case NEW:      return "new";
+    case READY:    return "ready";
+    case RUNNING:  return "running";
+    case BLOCKED:  return "blocked";
+    case FINISHED: return "finished";
+    case CRASHED:  return "crashed";
+    }
+    return "unknown";
+}
+
+// Order by finish time, then node id, then pid within node
+static int row_cmp(const void *a, const void *b) {
+    const Process *x = *(Process * const *)a, *y = *(Process * const *)b;
+    if (x->finish_time != y->finish_time) return x->finish_time < y->finish_time ? -1 : 1;
+    if (x->node != y->node) return x->node < y->node ? -1 : 1;
+    return (x->node_pid > y->node_pid) - (x->node_pid < y->node_pid);
+}
+
+// Per node weight and contended run totals that shares are measured against
+// The window runs from time zero to the first finish on the node, while every
+// starting proc still competes, so shares there are comparable to weights
+static void share_totals(void) {
+    for (int n = 1; n <= num_nodes; ++n) {
+        Node *nd = &nodes[n];
+        nd->weight_sum = nd->contended_sum = 0;
+        for (int i = 0; i < nd->proc_count; ++i) {
+            nd->weight_sum += proc_weight(nd->procs[i]);
+            nd->contended_sum += nd->procs[i]->run_contended;
+        }
+    }
+}
+
+// CPU share p got in the contended window and the share its weight entitles it to
+static void proc_shares(const Process *p, double *share, double *fair) {
+    const Node *nd = &nodes[p->node];
+    *share = nd->contended_sum ? (double)p->run_contended / nd->contended_sum : 0.0;
+    *fair  = nd->weight_sum ? (double)proc_weight(p) / nd->weight_sum : 0.0;
+}
+
+// One row per process then one per node, CSV or JSON Lines
+static void format_structured(Buf *b, Process **rows, int rc) {
+    int csv = (opt_summary == SUMMARY_CSV);
+    if (csv)
+        buf_printf(b, "kind,node,pid,name,state,finish,run,block,wait,sends,recvs,deadlines,missed,lateness,"
+                      "weight,share,fair_share,rdv_wait,timeouts,lost,"
+                      "clock,busy,idle,utilization,dispatches,messages,spawned,exited,spawn_failed,crashes\n");
+    for (int i = 0; i < rc; ++i) {
+        Process *p = rows[i];
+        double share, fair;
+        proc_shares(p, &share, &fair);
+        if (csv) {
+            buf_printf(b, "proc,%d,%d,", p->node, p->node_pid);
+            buf_csv_str(b, p->name);
+            buf_printf(b, ",%s,", state_name(p->state));
+            if (p->state == FINISHED) buf_printf(b, "%d", p->finish_time);
+            buf_printf(b, ",%d,%d,%d,%d,%d,%d,%d,%d,%d,%.4f,%.4f,%d,%d,%d,,,,,,,,,,\n",
+                       p->run_time, p->block_time, p->wait_time, p->sends, p->recvs,
+                       p->deadlines, p->missed, p->lateness, proc_weight(p), share, fair,
+                       p->rdv_wait, p->timeouts, p->lost);
+        } else {
+            buf_printf(b, "{\"kind\":\"proc\",\"node\":%d,\"pid\":%d,\"name\":", p->node, p->node_pid);
+            buf_json_str(b, p->name);
+            buf_printf(b, ",\"state\":\"%s\",\"finish\":", state_name(p->state));
+            if (p->state == FINISHED) buf_printf(b, "%d", p->finish_time);
+            else buf_printf(b, "null");
+            buf_printf(b, ",\"run\":%d,\"block\":%d,\"wait\":%d,\"sends\":%d,\"recvs\":%d,"
+                          "\"deadlines\":%d,\"missed\":%d,\"lateness\":%d,"
+                          "\"weight\":%d,\"share\":%.4f,\"fair_share\":%.4f,\"rdv_wait\":%d,"
+                          "\"timeouts\":%d,\"lost\":%d}\n",
+                       p->run_time, p->block_time, p->wait_time, p->sends, p->recvs,
+                       p->deadlines, p->missed, p->lateness, proc_weight(p), share, fair,
+                       p->rdv_wait, p->timeouts, p->lost);
+        }
+    }
+    for (int n = 1; n <= num_nodes; ++n) {
+        Node *nd = &nodes[n];
+        int idle = nd->clock - nd->busy_time;
+        double util = nd->clock > 0 ? (double)nd->busy_time / nd->clock : 0.0;
+        if (csv)
+            buf_printf(b, "node,%d,,,,,,,,,,,,,,,,,%d,%d,%d,%d,%d,%.4f,%d,%d,%d,%d,%d,%d\n",
+                       n, nd->timeouts, nd->lost, nd->clock, nd->busy_time, idle, util, nd->dispatches,
+                       nd->messages, nd->spawned, nd->exited, nd->spawn_failed, nd->crashes);
+        else
+            buf_printf(b, "{\"kind\":\"node\",\"node\":%d,\"timeouts\":%d,\"lost\":%d,\"clock\":%d,\"busy\":%d,"
+                          "\"idle\":%d,\"utilization\":%.4f,\"dispatches\":%d,\"messages\":%d,"
+                          "\"spawned\":%d,\"exited\":%d,\"spawn_failed\":%d,\"crashes\":%d}\n",
+                       n, nd->timeouts, nd->lost, nd->clock, nd->busy_time, idle, util, nd->dispatches,
+                       nd->messages, nd->spawned, nd->exited, nd->spawn_failed, nd->crashes);
+    }
+}
+
+// Build summary rows then print sorted by finish time and tie breaks
+static void print_summary(void) {
+    static Process *rows[MAX_PROCS * MAX_NODES]; int rc = 0;
     for (int n = 1; n <= num_nodes; ++n) {
         Node *nd = &nodes[n];
         for (int i = 0; i < nd->proc_count; ++i) {
             Process *p = nd->procs[i];
-            if (p->state == FINISHED) {
-                rows[rc].p = p;
-                rows[rc].finish = p->finish_time;
-                rows[rc].node_id = n;
-                rows[rc].node_pid = p->node_pid;
-                rows[rc].key = p->finish_time * 10000 + n * 100 + p->node_pid;
-                rc++;
+            // structured output also lists procs that never finished
+            if (p->state == FINISHED || p->state == CRASHED || opt_summary != SUMMARY_TEXT) rows[rc++] = p;
+        }
+    }
+    qsort(rows, rc, sizeof rows[0], row_cmp);
+    share_totals();
+
+    Buf b = { 0 };
+    if (opt_summary == SUMMARY_TEXT) {
+        for (int i = 0; i < rc; ++i) {
+            Process *p = rows[i];
+            buf_printf(&b, "| %05d | Proc %02d.%02d | Run %d, Block %d, Wait %d, Sends %d, Recvs %d",
+                       p->finish_time, p->node, p->node_pid,
+                       p->run_time, p->block_time, p->wait_time, p->sends, p->recvs);
+            if (workload_has_deadlines)
+                buf_printf(&b, ", Deadlines %d, Missed %d, Lateness %d", p->deadlines, p->missed, p->lateness);
+            if (workload_has_timeouts) buf_printf(&b, ", Timeouts %d", p->timeouts);
+            if (fault_count) buf_printf(&b, ", Lost %d%s", p->lost, p->state == CRASHED ? ", Crashed" : "");
+            if (opt_sched == POLICY_FAIR || opt_sched == POLICY_STRIDE || opt_sched == POLICY_LOTTERY) {
+                double share, fair;
+                proc_shares(p, &share, &fair);
+                buf_printf(&b, ", Weight %d, Share %.3f of %.3f", proc_weight(p), share, fair);
+            }
+            buf_printf(&b, "\n");
+        }
+        // procs that EXITed have no row of their own, only node totals
+        for (int n = 1; n <= num_nodes; ++n) {
+            Node *nd = &nodes[n];
+            if (nd->spawned == 0 && nd->spawn_failed == 0 && nd->exited == 0) continue;
+            buf_printf(&b, "| Node %02d | Spawned %d, Exited %d, Failed %d, Run %d, Block %d, Wait %d",
+                       n, nd->spawned, nd->exited, nd->spawn_failed,
+                       nd->exited_run, nd->exited_block, nd->exited_wait);
+            if (workload_has_deadlines) buf_printf(&b, ", Missed %d", nd->exited_missed);
+            buf_printf(&b, "\n");
+        }
+        if (have_baseline) {
+            RunTotals t = run_totals();
+            buf_printf(&b, "| Rendezvous | %s: Parties %d, Wait %lld | rr: Parties %d, Wait %lld | %+.1f%%\n",
+                       policy_label(), t.rendezvous, t.rdv_wait,
+                       baseline.rendezvous, baseline.rdv_wait,
+                       pct_change((double)t.rdv_wait, (double)baseline.rdv_wait));
+            if (t.chain_msgs || baseline.chain_msgs) {
+                double avg = t.chain_msgs ? (double)t.chain_sum / t.chain_msgs : 0;
+                double bavg = baseline.chain_msgs ? (double)baseline.chain_sum / baseline.chain_msgs : 0;
+                buf_printf(&b, "| Chains | %s: Messages %d, Latency %.2f, Max %d"
+                               " | rr: Messages %d, Latency %.2f, Max %d | %+.1f%%\n",
+                           policy_label(), t.chain_msgs, avg, t.chain_max,
+                           baseline.chain_msgs, bavg, baseline.chain_max, pct_change(avg, bavg));
+            }
+        }
+        if (have_faultless) {
+            int crashes = 0, hit = 0, restarts = 0, failed = 0, lost = 0;
+            for (int n = 1; n <= num_nodes; ++n) {
+                crashes += nodes[n].crashes;
+                hit += nodes[n].crash_procs;
+                restarts += nodes[n].restarts;
+                failed += nodes[n].rdv_failed;
+                lost += nodes[n].lost;
             }
+            int makespan = run_makespan();
+            buf_printf(&b, "| Faults | %s: Crashes %d, Procs hit %d, Restarted %d, Failed partners %d, Lost work %d"
+                           " | Makespan %d vs %d without faults, %+.1f%%\n",
+                       fault_policy_name[opt_fault_policy], crashes, hit, restarts, failed, lost,
+                       makespan, faultless_makespan, pct_change(makespan, faultless_makespan));
         }
+    } else {
+        format_structured(&b, rows, rc);
     }
-    // Insertion sort is fine for small count
-    for (int i = 1; i < rc; ++i) {
-        Row x = rows[i]; int j = i - 1;
-        while (j >= 0 && rows[j].key > x.key) { rows[j + 1] = rows[j]; --j; }
-        rows[j + 1] = x;
+
+    FILE *out = stdout;
+    if (opt_summary_out && !(out = fopen(opt_summary_out, "w"))) {
+        fprintf(stderr, "prosim: cannot open %s\n", opt_summary_out);
+        exit(1);
     }
-    for (int i = 0; i < rc; ++i) {
-        Process *p = rows[i].p;
-        printf("| %05d | Proc %02d.%02d | Run %d, Block %d, Wait %d, Sends %d, Recvs %d\n",
-               rows[i].finish, rows[i].node_id, rows[i].node_pid,
-               p->run_time, p->block_time, p->wait_time, p->sends, p->recvs);
+    fflush(stdout);   // keep trace ahead of the summary when both share stdout
+    if (b.len) fwrite(b.p, 1, b.len, out);
+    if (out != stdout) fclose(out);
+    free(b.p);
+    mem_add(MEM_OUTPUT, -(long long)b.cap);
+}
+
+/* --------- replications --------- */
+// Samples from every replication, slot r * total_procs + i, NAN if not finished
+static double *rep_finish, *rep_wait, *rep_makespan;
+static int rep_next = 0;
+static pthread_mutex_t rep_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Worker claims replication indices until all are done
+static void *replication_worker(void *arg) {
+    (void)arg;
+    sim_alloc();
+    for (;;) {
+        pthread_mutex_lock(&rep_lock);
+        int r = rep_next++;
+        pthread_mutex_unlock(&rep_lock);
+        if (r >= opt_replications) break;
+
+        sim_reset(opt_seed + (uint64_t)r);
+        sim_run();
+
+        for (int i = 0; i < total_procs; ++i) {
+            Process *p = &all_procs[i];
+            int done = (p->state == FINISHED);
+            rep_finish[(size_t)r * total_procs + i] = done ? p->finish_time : NAN;
+            rep_wait  [(size_t)r * total_procs + i] = done ? p->wait_time   : NAN;
+        }
+        rep_makespan[r] = run_makespan();
+        if (board) {
+            // workers only add whole replications, the board owner stores running totals;
+            // the gauges show the replication that finished last
+            atomic_fetch_add_explicit(&board->events, sim_events, memory_order_relaxed);
+            atomic_fetch_add_explicit(&board->replications_done, 1, memory_order_relaxed);
+            metrics_publish_nodes();
+        }
+    }
+    sim_free();
+    return NULL;
+}
+
+// Two sided 95 percent t quantile for df degrees of freedom
+static double t95(int df) {
+    static const double t[] = { 0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+        2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    if (df < 1) return 0;
+    if (df <= 30) return t[df];
+    return 1.960;
+}
+
+// Mean and 95 percent half width over samples at x[0], x[stride], ... skipping NAN
+static int mean_ci(const double *x, int count, int stride, double *mean, double *half) {
+    double sum = 0, sq = 0; int n = 0;
+    for (int i = 0; i < count; ++i) {
+        double v = x[(size_t)i * stride];
+        if (isnan(v)) continue;
+        sum += v; n++;
+    }
+    *mean = n ? sum / n : 0;
+    for (int i = 0; i < count; ++i) {
+        double v = x[(size_t)i * stride];
+        if (isnan(v)) continue;
+        sq += (v - *mean) * (v - *mean);
+    }
+    *half = n > 1 ? t95(n - 1) * sqrt(sq / (n - 1)) / sqrt(n) : 0;
+    return n;
+}
+
+// Run opt_replications seeds across worker threads and report intervals
+static void run_replications(void) {
+    int R = opt_replications;
+    rep_finish   = malloc(sizeof(double) * (size_t)R * (total_procs ? total_procs : 1));
+    rep_wait     = malloc(sizeof(double) * (size_t)R * (total_procs ? total_procs : 1));
+    rep_makespan = malloc(sizeof(double) * (size_t)R);
+    if (!rep_finish || !rep_wait || !rep_makespan) {
+        fprintf(stderr, "prosim: out of memory\n");
+        exit(1);
+    }
+
+    int threads = opt_threads;
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+    if (threads > R)  threads = R;
+
+    trace_filter_none();
+    pthread_t *tid = calloc(threads, sizeof(pthread_t));
+    for (int t = 0; t < threads; ++t) {
+        if (pthread_create(&tid[t], NULL, replication_worker, NULL) != 0) {
+            fprintf(stderr, "prosim: cannot start replication thread\n");
+            exit(1);
+        }
+    }
+    for (int t = 0; t < threads; ++t) pthread_join(tid[t], NULL);
+    free(tid);
+
+    // Report in node and pid order, intervals are 95 percent Student t
+    printf("| Replications %d | Seed %llu\n", R, (unsigned long long)opt_seed);
+    for (int n = 1; n <= num_nodes; ++n) {
+        for (int i = 0; i < total_procs; ++i) {
+            Process *p = &proto_procs[i];
+            if (p->node != n) continue;
+            double fm, fh, wm, wh;
+            int fn = mean_ci(&rep_finish[i], R, total_procs, &fm, &fh);
+            mean_ci(&rep_wait[i], R, total_procs, &wm, &wh);
+            printf("| Proc %02d.%02d | Finish %.2f +/- %.2f, Wait %.2f +/- %.2f, Finished %d/%d\n",
+                   n, p->node_pid, fm, fh, wm, wh, fn, R);
+        }
+    }
+    double mm, mh;
+    mean_ci(rep_makespan, R, 1, &mm, &mh);
+    printf("| Makespan %.2f +/- %.2f\n", mm, mh);
+
+    free(rep_finish); free(rep_wait); free(rep_makespan);
+}
+
+/* --------- options --------- */
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "usage: %s [options] < workload\n"
+        "  -s, --seed N           seed for distribution operands (default 1)\n"
+        "  -R, --replications N   run N seeds and report 95%% confidence intervals\n"
+        "  -j, --threads N        worker threads for replications (default cpus)\n"
+        "  -f, --summary FORMAT   final summary as text, csv or json (JSON Lines)\n"
+        "  -o, --summary-out FILE write the final summary to FILE instead of stdout\n"
+        "  -i, --sample-interval T  sample every node each T simulated ticks\n"
+        "      --sample-out FILE    where samples go, - for stdout (required with -i)\n"
+        "      --sample-format F    csv (default) or bin, columnar int32\n"
+        "  -t, --trace-filter EXPR  trace only matching lines, e.g.\n"
+        "                           'node=1-3,5;pid=1;state=running,blocked;time=100-200'\n"
+        "  -T, --trace-file FILE    write the trace as a time indexed block file\n"
+        "                           for tracetool instead of to stdout\n"
+        "  -z, --trace-compress     LZ compress trace file blocks on a helper thread\n"
+        "      --sched POLICY       ready queue order: rr (default), edf, fair, gang,\n"
+        "                           stride or lottery\n"
+        "      --comm-boost N       run procs released by a SEND/RECV match from a\n"
+        "                           queue of their own, up to N dispatches in a row\n"
+        "      --perf               count cycles, instructions, cache and branch misses\n"
+        "                           per engine phase, report on stderr at exit\n"
+        "      --metrics-socket PATH  serve live metrics on a Unix socket, Prometheus\n"
+        "                           text format\n"
+        "      --progress SECONDS   progress line on stderr every SECONDS of wall time\n"
+        "      --memory             memory breakdown by kind on stderr at exit\n"
+        "      --dry-run            read the workload, print projected peak memory and\n"
+        "                           stop without simulating\n"
+        "      --reference          run the original, unoptimized matching engine\n"
+        "      --diff               run both engines, report the first line that differs\n"
+        "      --partitions N       split the nodes across N worker processes that share\n"
+        "                           memory, output is the same as a single process run\n"
+        "      --part-stats         cpu time of each partition against its simulated work\n"
+        "      --checkpoint DIR     save checkpoints in DIR and resume from the latest one\n"
+        "                           an edited workload still matches\n"
+        "      --checkpoint-every T ticks between checkpoints (default 1000)\n"
+        "      --cache DIR          print the stored output of an identical earlier run,\n"
+        "                           or run and store it in DIR\n"
+        "      --cache-size MIB     drop least recently used outputs past MIB (default 64)\n"
+        "      --fault NODE:T[:T2]  crash NODE at tick T, back up at T2 or never, repeatable\n"
+        "      --fault-policy P     what a crash does to its procs: wait (default) restarts\n"
+        "                           them on recovery, fail drops them and fails their\n"
+        "                           partners, migrate restarts them on another node\n",
+        prog);
+}
+
+// One --fault NODE:T[:T2], zero when it does not parse
+static int parse_fault(const char *v) {
+    Fault f = { 0, 0, 0x3fffffff, 0 };
+    char tail;
+    int n = sscanf(v, "%d:%d:%d%c", &f.node, &f.at, &f.until, &tail);
+    if (n != 2 && n != 3) return 0;
+    if (f.node < 1 || f.node > MAX_NODES || f.at < 0 || f.until <= f.at || fault_count == MAX_FAULTS) return 0;
+    faults[fault_count++] = f;
+    return 1;
+}
+
+static int fault_cmp(const void *a, const void *b) {
+    const Fault *x = a, *y = b;
+    if (x->node != y->node) return x->node < y->node ? -1 : 1;
+    return (x->at > y->at) - (x->at < y->at);
+}
+
+static void parse_args(int argc, char **argv) {
+    trace_filter_all();
+    static const struct option longopts[] = {
+        { "seed",         required_argument, NULL, 's' },
+        { "replications", required_argument, NULL, 'R' },
+        { "threads",      required_argument, NULL, 'j' },
+        { "summary",      required_argument, NULL, 'f' },
+        { "summary-out",  required_argument, NULL, 'o' },
+        { "sample-interval", required_argument, NULL, 'i' },
+        { "sample-out",      required_argument, NULL, 1000 },
+        { "sample-format",   required_argument, NULL, 1001 },
+        { "trace-filter",    required_argument, NULL, 't' },
+        { "trace-file",      required_argument, NULL, 'T' },
+        { "trace-compress",  no_argument,       NULL, 'z' },
+        { "sched",           required_argument, NULL, 1002 },
+        { "comm-boost",      required_argument, NULL, 1003 },
+        { "perf",            no_argument,       NULL, 1004 },
+        { "metrics-socket",  required_argument, NULL, 1005 },
+        { "progress",        required_argument, NULL, 1006 },
+        { "memory",          no_argument,       NULL, 1007 },
+        { "dry-run",         no_argument,       NULL, 1008 },
+        { "reference",       no_argument,       NULL, 1009 },
+        { "diff",            no_argument,       NULL, 1010 },
+        { "partitions",      required_argument, NULL, 1011 },
+        { "part-stats",      no_argument,       NULL, 1012 },
+        { "checkpoint",      required_argument, NULL, 1013 },
+        { "checkpoint-every", required_argument, NULL, 1014 },
+        { "cache",           required_argument, NULL, 1015 },
+        { "cache-size",      required_argument, NULL, 1016 },
+        { "fault",           required_argument, NULL, 1017 },
+        { "fault-policy",    required_argument, NULL, 1018 },
+        { "help",         no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "s:R:j:f:o:i:t:T:zh", longopts, NULL)) != -1) {
+        switch (c) {
+        case 's': opt_seed = strtoull(optarg, NULL, 0); break;
+        case 'R': opt_replications = atoi(optarg); break;
+        case 'j': opt_threads = atoi(optarg); break;
+        case 'f':
+            if      (strcmp(optarg, "text") == 0) opt_summary = SUMMARY_TEXT;
+            else if (strcmp(optarg, "csv")  == 0) opt_summary = SUMMARY_CSV;
+            else if (strcmp(optarg, "json") == 0) opt_summary = SUMMARY_JSON;
+            else { usage(argv[0]); exit(2); }
+            break;
+        case 'o': opt_summary_out = optarg; break;
+        case 'i': opt_sample_interval = atoi(optarg); break;
+        case 1000: opt_sample_out = optarg; break;
+        case 'T': opt_trace_file = optarg; break;
+        case 'z': opt_trace_compress = 1; break;
+        case 't':
+            if (!trace_filter_compile(optarg)) {
+                fprintf(stderr, "prosim: bad trace filter '%s'\n", optarg);
+                exit(2);
+            }
+            break;
+        case 1001:
+            if      (strcmp(optarg, "csv") == 0) opt_sample_format = SAMPLE_CSV;
+            else if (strcmp(optarg, "bin") == 0) opt_sample_format = SAMPLE_BIN;
+            else { usage(argv[0]); exit(2); }
+            break;
+        case 1002:
+            if      (strcmp(optarg, "rr")  == 0) opt_sched = POLICY_RR;
+            else if (strcmp(optarg, "edf") == 0) opt_sched = POLICY_EDF;
+            else if (strcmp(optarg, "fair") == 0) opt_sched = POLICY_FAIR;
+            else if (strcmp(optarg, "gang") == 0) opt_sched = POLICY_GANG;
+            else if (strcmp(optarg, "stride")  == 0) opt_sched = POLICY_STRIDE;
+            else if (strcmp(optarg, "lottery") == 0) opt_sched = POLICY_LOTTERY;
+            else { usage(argv[0]); exit(2); }
+            break;
+        case 1003: opt_comm_boost = atoi(optarg); break;
+        case 1004: opt_perf = 1; break;
+        case 1005: opt_metrics = optarg; break;
+        case 1006: opt_progress = atof(optarg); break;
+        case 1007: opt_memory = 1; break;
+        case 1008: opt_dry_run = 1; break;
+        case 1009: opt_reference = 1; break;
+        case 1010: opt_diff = 1; break;
+        case 1011: opt_partitions = atoi(optarg); break;
+        case 1012: opt_part_stats = 1; break;
+        case 1013: opt_checkpoint = optarg; break;
+        case 1014: opt_checkpoint_every = atoi(optarg); break;
+        case 1015: opt_cache = optarg; break;
+        case 1016: opt_cache_size = atoll(optarg); break;
+        case 1017:
+            if (!parse_fault(optarg)) {
+                fprintf(stderr, "prosim: bad fault '%s', want NODE:T or NODE:T:T2 with T2 after T\n", optarg);
+                exit(2);
+            }
+            break;
+        case 1018:
+            if      (strcmp(optarg, "wait") == 0)    opt_fault_policy = FAULT_WAIT;
+            else if (strcmp(optarg, "fail") == 0)    opt_fault_policy = FAULT_FAIL;
+            else if (strcmp(optarg, "migrate") == 0) opt_fault_policy = FAULT_MIGRATE;
+            else { usage(argv[0]); exit(2); }
+            break;
+        case 'h': usage(argv[0]); exit(0);
+        default:  usage(argv[0]); exit(2);
+        }
+    }
+    if (opt_replications < 0 || opt_threads < 0 || opt_sample_interval < 0 || opt_comm_boost < 0
+        || opt_progress < 0 || opt_partitions < 0 || opt_checkpoint_every < 1 || opt_cache_size < 0) {
+        usage(argv[0]);
+        exit(2);
+    }
+    if (opt_sample_interval && !opt_sample_out) {
+        fprintf(stderr, "prosim: --sample-interval needs --sample-out\n");
+        exit(2);
+    }
+    if (opt_trace_compress && !opt_trace_file) {
+        fprintf(stderr, "prosim: --trace-compress needs --trace-file\n");
+        exit(2);
+    }
+    if (opt_diff && (opt_replications || opt_trace_file || opt_summary_out || opt_sample_interval)) {
+        fprintf(stderr, "prosim: --diff compares standard output, drop -R, -T, -o and -i\n");
+        exit(2);
+    }
+    if (opt_partitions && (opt_replications || opt_sample_interval || opt_perf || opt_metrics || opt_progress > 0)) {
+        fprintf(stderr, "prosim: --partitions runs one simulation, drop -R, -i, --perf, --metrics-socket and --progress\n");
+        exit(2);
+    }
+    if (opt_checkpoint && (opt_replications || opt_trace_file || opt_sample_interval || opt_diff || opt_partitions)) {
+        fprintf(stderr, "prosim: --checkpoint saves the standard output trace of one run, "
+                        "drop -R, -T, -i, --diff and --partitions\n");
+        exit(2);
+    }
+    if (opt_cache && (opt_trace_file || opt_summary_out || opt_sample_interval || opt_checkpoint
+                      || opt_diff || opt_dry_run)) {
+        fprintf(stderr, "prosim: --cache stores standard output, "
+                        "drop -T, -o, -i, --checkpoint, --diff and --dry-run\n");
+        exit(2);
+    }
+    if (fault_count && opt_partitions) {
+        fprintf(stderr, "prosim: --fault moves procs between nodes, drop --partitions\n");
+        exit(2);
+    }
+    // each node takes its crashes in time order, one at a time
+    qsort(faults, fault_count, sizeof faults[0], fault_cmp);
+    for (int i = 0; i < fault_count; ++i) {
+        int same = i > 0 && faults[i - 1].node == faults[i].node;
+        if (same && faults[i].at < faults[i - 1].until) {
+            fprintf(stderr, "prosim: faults on node %d overlap\n", faults[i].node);
+            exit(2);
+        }
+        faults[i].seq = same ? faults[i - 1].seq + 1 : 0;
+    }
+    // replications run in parallel with no trace, sampling covers single runs only
+    if (opt_replications) opt_sample_interval = 0;
+}
+
+/* --------- dry run --------- */
+// Expected ticks of a DOOP or BLOCK operand
+static double op_mean_ticks(const Operation *op) {
+    switch (op->dist) {
+    case DIST_UNIFORM:   return (op->d1 + op->d2) / 2;
+    case DIST_EXP:       return op->d1;
+    case DIST_LOGNORMAL: return exp(op->d1 + op->d2 * op->d2 / 2);
+    default:             return op->a;
+    }
+}
+
+// Smallest buffer the doubling in buf_reserve reaches for len bytes
+static long long buf_cap_for(long long len) {
+    long long cap = 4096;
+    while (cap < len) cap *= 2;
+    return cap;
+}
+
+/* Projected peak from the parsed workload alone
+ *
+ * Fixed sim state is exact. Spawned records assume every SPAWN op runs once
+ * and its template runs to completion, capped by the node pid space. The
+ * sample horizon is each node's work done back to back, so waits for
+ * messages make the real count larger. Summary rows are sized per format.
+ */
+static void dry_run(void) {
+    long long b[MEM_COUNT] = { 0 };
+    mem_procs(b, total_procs);   // proto_procs is static but counts
+
+    int sims = 1;
+    if (opt_replications > 0) {
+        sims = opt_threads > 0 ? opt_threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (sims <= 0) sims = 1;
+        if (sims > opt_replications) sims = opt_replications;
+    }
+    // a baseline run before the real one frees its state first
+    for (int t = 0; t < sims; ++t) mem_sim_state(b);
+
+    int live[MAX_NODES + 1] = { 0 }, spawned[MAX_NODES + 1] = { 0 };
+    double work[MAX_NODES + 1] = { 0 };
+    for (int i = 0; i < total_procs; ++i) {
+        const Process *p = &proto_procs[i];
+        if (p->node >= 1 && p->node <= num_nodes) live[p->node]++;
+        for (int k = 0; k < p->op_count; ++k) {
+            const Operation *op = &p->ops[k];
+            if (op->type == SPAWN && op->a >= 1 && op->a <= num_nodes) spawned[op->a]++;
+            if ((op->type == DOOP || op->type == BLOCK) && p->node >= 1 && p->node <= num_nodes)
+                work[p->node] += op_mean_ticks(op);
+        }
+    }
+    for (int i = 0; i < total_procs; ++i) {
+        const Process *p = &proto_procs[i];
+        if (p->node != 0) continue;
+        // a template's work lands on whichever node spawns it, charge the busiest
+        int n = 1;
+        for (int m = 2; m <= num_nodes; ++m) if (spawned[m] > spawned[n]) n = m;
+        for (int k = 0; k < p->op_count; ++k)
+            if (p->ops[k].type == DOOP || p->ops[k].type == BLOCK) work[n] += op_mean_ticks(&p->ops[k]);
+    }
+
+    int slabs = 0;
+    long long rows = 0, sample_rows = 0;
+    for (int n = 1; n <= num_nodes; ++n) {
+        int extra = spawned[n];
+        if (extra > MAX_NODE_PID - live[n]) extra = MAX_NODE_PID - live[n];
+        if (extra < 0) extra = 0;
+        slabs += (extra + SLAB_PROCS - 1) / SLAB_PROCS;
+        rows += live[n] + extra;
+        if (opt_sample_interval) sample_rows += (long long)(work[n] / opt_sample_interval) + 1;
+    }
+    long long spawn_b[MEM_COUNT] = { 0 };
+    mem_procs(spawn_b, (long long)slabs * SLAB_PROCS);
+    for (int k = 0; k < MEM_COUNT; ++k) b[k] += spawn_b[k] * sims;
+
+    if (sample_rows) {
+        long long cap = 1024;
+        while (cap < sample_rows) cap *= 2;
+        b[MEM_OUTPUT] += cap * (long long)SAMPLE_ROW_BYTES;
+    }
+    if (opt_replications == 0) {
+        int row_bytes = opt_summary == SUMMARY_TEXT ? 96 : opt_summary == SUMMARY_CSV ? 160 : 360;
+        b[MEM_OUTPUT] += buf_cap_for((rows + num_nodes + 4) * row_bytes);
+        if (opt_trace_file) b[MEM_OUTPUT] += (long long)tf_buffer_bytes(opt_trace_compress);
+    }
+
+    int templates = 0;
+    for (int i = 0; i < total_procs; ++i) templates += (proto_procs[i].node == 0);
+    printf("| Dry run | %d procs, %d templates, %d nodes, %d spawn slabs, %d sim %s |\n",
+           total_procs - templates, templates, num_nodes, slabs, sims, sims == 1 ? "thread" : "threads");
+    // sizes follow the record layout, so they go with the other memory lines
+    mem_line(stderr, "projected peak", b);
+}
+
+/* --------- differential run --------- */
+// Run the workload once with the given engine in a child, its stdout into a temp file
+static FILE *engine_output(int reference) {
+    FILE *f = tmpfile();
+    if (!f) { fprintf(stderr, "prosim: cannot create a temp file\n"); exit(1); }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) { fprintf(stderr, "prosim: cannot fork\n"); exit(1); }
+    if (pid == 0) {
+        dup2(fileno(f), STDOUT_FILENO);
+        opt_reference = reference;
+        if (reference) opt_partitions = 0;   // partitions are checked against the plain engine
+        sim_alloc();
+        if (opt_sched == POLICY_GANG || opt_comm_boost) run_baseline();
+        if (fault_count) run_faultless();
+        sim_reset(opt_seed);
+        if (opt_partitions) part_start(opt_partitions);
+        sim_run();
+        if (part_count) part_stop();
+        print_summary();
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "prosim: %s engine failed\n", reference ? "reference" : "fast");
+        exit(1);
+    }
+    rewind(f);
+    return f;
+}
+
+// Both engines on the parsed workload, zero when every output line agrees
+static int diff_engines(void) {
+    FILE *fast = engine_output(0), *ref = engine_output(1);
+    char a[512], b[512];
+    for (int line = 1;; ++line) {
+        char *x = fgets(a, sizeof a, fast), *y = fgets(b, sizeof b, ref);
+        if (!x && !y) {
+            printf("| Diff | fast and reference agree on %d lines\n", line - 1);
+            return 0;
+        }
+        if (x && y && strcmp(a, b) == 0) continue;
+        // trace lines start with the node in brackets, the rest is summary
+        const char *which = (x && a[0] == '[') || (y && b[0] == '[') ? "trace line" : "summary row";
+        if (x) a[strcspn(a, "\n")] = 0;
+        if (y) b[strcspn(b, "\n")] = 0;
+        printf("| Diff | first divergence at line %d, %s\n", line, which);
+        printf("| fast      | %s\n", x ? a : "(end of output)");
+        printf("| reference | %s\n", y ? b : "(end of output)");
+        return 1;
+    }
+}
+
+/* --------- result cache --------- */
+/* With --cache DIR a run first hashes the parsed workload with every
+ * option that changes standard output. A hit prints the stored output
+ * and skips the simulation. On a miss a child runs as usual with its
+ * standard output in a temp file; the parent passes the output on, stores
+ * it as DIR/KEY.out and trims the directory to --cache-size, least
+ * recently used first. Keys include the build time and the bytes of every
+ * plugin library, so a rebuilt prosim or plugin never serves what an older
+ * one printed.
+ */
+// The seed only matters to drawn operands, plugins and the lottery
+static int seed_matters(void) {
+    if (opt_sched == POLICY_LOTTERY || opt_replications) return 1;
+    for (int i = 0; i < total_procs; ++i) {
+        if (proto_procs[i].behavior) return 1;
+        for (int k = 0; k < proto_procs[i].op_count; ++k)
+            if (proto_procs[i].ops[k].dist != DIST_FIXED) return 1;
+    }
+    return 0;
+}
+
+static uint64_t cache_key(void) {
+    static const char build[] = __DATE__ " " __TIME__;
+    uint64_t h = store_hash(STORE_HASH_INIT, build, sizeof build);
+    int summary = opt_summary;
+    FOLD(opt_replications); FOLD(summary);
+    return hash_workload(hash_options(h, seed_matters()), NULL);
+}
+
+// Nonzero when standard output was served here, zero in the child that simulates
+static int cache_serve(int *status) {
+    if (store_open(opt_cache) != 0) {
+        fprintf(stderr, "prosim: cannot use %s for the cache\n", opt_cache);
+        exit(1);
+    }
+    uint64_t key = cache_key();
+    size_t len;
+    char *out = store_get(opt_cache, ".out", key, &len);
+    if (out) {
+        fwrite(out, 1, len, stdout);
+        free(out);
+        store_touch(opt_cache, ".out", key);
+        fprintf(stderr, "| Cache | hit %s/%016llx.out\n", opt_cache, (unsigned long long)key);
+        *status = 0;
+        return 1;
+    }
+
+    FILE *f = tmpfile();
+    if (!f) { fprintf(stderr, "prosim: cannot create a temp file\n"); exit(1); }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) { fprintf(stderr, "prosim: cannot fork\n"); exit(1); }
+    if (pid == 0) {
+        dup2(fileno(f), STDOUT_FILENO);
+        return 0;
+    }
+    int st;
+    if (waitpid(pid, &st, 0) != pid || !WIFEXITED(st)) { fprintf(stderr, "prosim: run failed\n"); exit(1); }
+    *status = WEXITSTATUS(st);
+
+    // store only a clean run, then pass the output on either way
+    rewind(f);
+    Buf b = { 0 };
+    char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof chunk, f)) > 0) buf_add(&b, chunk, n);
+    fclose(f);
+    if (*status == 0) {
+        long long bytes;
+        int count;
+        if (store_put(opt_cache, ".out", key, b.p ? b.p : "", b.len) != 0)
+            fprintf(stderr, "prosim: cannot write to the cache in %s\n", opt_cache);
+        store_trim(opt_cache, ".out", opt_cache_size << 20, &bytes, &count);
+        fprintf(stderr, "| Cache | miss, stored %016llx.out | %d entries, %.1f of %lld MiB\n",
+                (unsigned long long)key, count, bytes / 1048576.0, opt_cache_size);
+    }
+    fwrite(b.p ? b.p : "", 1, b.len, stdout);
+    mem_add(MEM_OUTPUT, -(long long)b.cap);
+    free(b.p);
+    return 1;
+}
+
+/* --------- main --------- */
+int main(int argc, char **argv) {
+    parse_args(argc, argv);
+
+    // Input header: count of procs, count of nodes, quantum
+    if (scanf("%d %d %d", &total_procs, &num_nodes, &quantum) != 3) return 0;
+
+    for (int i = 0; i < fault_count; ++i) {
+        if (faults[i].node > num_nodes) {
+            fprintf(stderr, "prosim: --fault names node %d, the workload has %d\n", faults[i].node, num_nodes);
+            return 2;
+        }
+    }
+
+    int node_counts[MAX_NODES + 1] = {0};
+    for (int i = 0; i < total_procs; ++i) {
+        // Read one process line then parse its program
+        char name[32]; int size, prio, node_id;
+        if (scanf("%31s %d %d %d", name, &size, &prio, &node_id) != 4) return 0;
+
+        Process *p = &proto_procs[i];
+        strcpy(p->name, name);
+        p->size = size; p->priority = prio; p->node = node_id;
+        p->pid_global = i + 1;
+        p->proto = i;
+        p->node_pid = ++node_counts[node_id];
+        p->home = node_id * 100 + p->node_pid;
+        p->op_count = 0; p->pc = 0;
+        p->state = NEW;
+        p->run_time = p->block_time = p->wait_time = p->finish_time = 0;
+        p->unblock_time = 0;
+        p->sends = p->recvs = 0;
+        p->want_dst_addr = 0; p->want_src_addr = 0;
+        p->behavior = NULL;
+        memset(&p->ctx, 0, sizeof p->ctx);
+
+        /* Expand LOOP and END then stop at HALT or PLUGIN */
+        if (parse_block_into(p->ops, &p->op_count, 0) == 2)
+            p->behavior = load_behavior(plugin_path, plugin_sym, &p->ctx.arg);
+        // a plugin may yield a timeout at any point, its runs can not tell ahead
+        if (p->behavior) workload_has_timeouts = 1;
+
+        // a plugin may send at any point, so only plain programs end chains
+        int sends = 0;
+        for (int k = 0; k < p->op_count; ++k) sends |= (p->ops[k].type == SEND);
+        p->chain_sink = !sends && !p->behavior;
+    }
+
+    // Procs on node zero are SPAWN templates, bind SPAWN ops to them by name
+    int spawn_tmpl[MAX_PROCS];
+    for (int k = 0; k < spawn_name_count; ++k) {
+        spawn_tmpl[k] = -1;
+        for (int i = 0; i < total_procs; ++i)
+            if (proto_procs[i].node == 0 && strcmp(proto_procs[i].name, spawn_names[k]) == 0) spawn_tmpl[k] = i;
+        if (spawn_tmpl[k] < 0) {
+            fprintf(stderr, "prosim: SPAWN of %s, which is not a node 0 template\n", spawn_names[k]);
+            return 1;
+        }
+    }
+    for (int i = 0; i < total_procs; ++i)
+        for (int k = 0; k < proto_procs[i].op_count; ++k)
+            if (proto_procs[i].ops[k].type == SPAWN) proto_procs[i].ops[k].b = spawn_tmpl[proto_procs[i].ops[k].b];
+
+    gang_assign();
+
+    if (opt_dry_run) {
+        dry_run();
+        return 0;
+    }
+    if (opt_diff) return diff_engines();
+    int status;
+    if (opt_cache && cache_serve(&status)) return status;
+    long long proto_b[MEM_COUNT] = { 0 };
+    mem_procs(proto_b, total_procs);
+    mem_add_all(proto_b, 1);
+
+    if (opt_metrics || opt_progress > 0) {
+        board = mx_board(num_nodes);
+        if (!board) { fprintf(stderr, "prosim: out of memory\n"); return 1; }
+        atomic_store(&board->procs_total, total_procs);
+        atomic_store(&board->replications, opt_replications);
+        atomic_store(&board->running, 1);
+        if (opt_metrics && mx_start(board, opt_metrics) != 0) {
+            fprintf(stderr, "prosim: cannot serve metrics on %s\n", opt_metrics);
+            return 1;
+        }
+        if (opt_progress > 0 && mx_progress(board, opt_progress) != 0) {
+            fprintf(stderr, "prosim: cannot start progress reporter\n");
+            return 1;
+        }
+    }
+
+    if (opt_replications > 0) {
+        run_replications();
+        mem_report("exit");
+        perf_report();
+        metrics_stop();
+        return 0;
+    }
+
+    if (opt_trace_file && !(trace_file = tf_open(opt_trace_file, opt_trace_compress))) {
+        fprintf(stderr, "prosim: cannot open %s\n", opt_trace_file);
+        return 1;
+    }
+    if (trace_file) mem_add(MEM_OUTPUT, (long long)tf_buffer_bytes(opt_trace_compress));
+
+    sim_alloc();
+    board_owner = (board != NULL);
+    if (opt_sched == POLICY_GANG || opt_comm_boost) run_baseline();
+    if (fault_count) run_faultless();
+    sim_reset(opt_seed);
+    if (opt_checkpoint) ckpt_resume();
+    if (opt_partitions) part_start(opt_partitions);
+    sim_run();
+    if (part_count) part_stop();
+    if (trace_file && tf_close(trace_file) != 0) {
+        fprintf(stderr, "prosim: cannot write %s\n", opt_trace_file);
+        return 1;
     }
+    if (trace_file) mem_add(MEM_OUTPUT, -(long long)tf_buffer_bytes(opt_trace_compress));
+    print_summary();
+    if (opt_sample_interval) sample_write();
+    sim_free();
+    mem_report("exit");
+    perf_report();
+    metrics_stop();
     return 0;
 }
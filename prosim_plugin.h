@@ -0,0 +1,85 @@
+#ifndef PROSIM_PLUGIN_H
+#define PROSIM_PLUGIN_H
+
+#include <stdint.h>
+
+/* Process behavior plugins
+ *
+ * A program line "PLUGIN ./lib.so symbol[:arg]" hands the rest of a
+ * process to a function in a shared object. prosim calls the function
+ * each time the process needs its next operation. The function writes
+ * one operation and returns, so it must keep its place in ctx and not
+ * in C locals. The PS_ macros below turn a plain function body into
+ * such a resumable state machine:
+ *
+ *     int relay(ps_ctx *ctx, ps_op *op) {
+ *         PS_BEGIN(ctx);
+ *         for (ctx->v[0] = 0; ctx->v[0] < 3; ctx->v[0]++) {
+ *             PS_YIELD(ctx, op, PS_RECV, 101);
+ *             PS_YIELD(ctx, op, PS_SEND, ctx->recvs % 2 ? 201 : 301);
+ *         }
+ *         PS_END(ctx, op);
+ *     }
+ *
+ * PS_YIELD_TIMEOUT gives a SEND or RECV a tick limit, ctx->last_status
+ * then tells whether the partner came or the wait ran out. Under
+ * --fault-policy fail it can also say the partner's node crashed.
+ *
+ * Every process has its own ctx, and replications run in parallel, so a
+ * behavior must keep all state in ctx and never in static variables.
+ */
+
+// Operation kinds a behavior can yield, same meaning as in the input
+typedef enum { PS_DOOP, PS_BLOCK, PS_SEND, PS_RECV, PS_HALT } ps_kind;
+
+// How the last SEND or RECV ended, PS_FAILED when the partner was lost in a crash
+typedef enum { PS_OK, PS_TIMEOUT, PS_FAILED } ps_status;
+
+typedef struct {
+    ps_kind kind;
+    int arg;           // ticks for DOOP and BLOCK, address for SEND and RECV
+    int timeout;       // SEND and RECV give up after this many ticks, zero waits forever
+} ps_op;
+
+typedef struct {
+    int resume;        // coroutine resume point, zero before the first call
+
+    // read only, refreshed by prosim before every call
+    int node, pid;     // where the process runs
+    int addr;          // own address, node * 100 + pid
+    int now;           // node clock when the operation is requested
+    int sends, recvs;  // completed rendezvous so far
+    int last_status;   // ps_status of the last SEND or RECV
+    uint64_t seed;     // per process seed for any randomness the behavior wants
+    const char *arg;   // text after ':' in the PLUGIN line, "" if none
+
+    long v[16];        // behavior owned state, zero at start
+} ps_ctx;
+
+// Fill op with the next operation, return nonzero on success
+// Returning zero ends the process as if it yielded PS_HALT
+typedef int (*ps_behavior)(ps_ctx *ctx, ps_op *op);
+
+#define PS_BEGIN(ctx)  switch ((ctx)->resume) { case 0:
+
+#define PS_YIELD(ctx, op, k, a)                                   \
+    do {                                                          \
+        (op)->kind = (k); (op)->arg = (a);                        \
+        (ctx)->resume = __LINE__; return 1;                       \
+        case __LINE__:;                                           \
+    } while (0)
+
+#define PS_YIELD_TIMEOUT(ctx, op, k, a, t)                        \
+    do {                                                          \
+        (op)->kind = (k); (op)->arg = (a); (op)->timeout = (t);   \
+        (ctx)->resume = __LINE__; return 1;                       \
+        case __LINE__:;                                           \
+    } while (0)
+
+#define PS_END(ctx, op)                                           \
+    }                                                             \
+    (op)->kind = PS_HALT; (op)->arg = 0;                          \
+    (ctx)->resume = -1;                                           \
+    return 1
+
+#endif
@@ -0,0 +1,74 @@
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "shmring.h"
+
+void *shm_alloc(size_t bytes) {
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+void shm_free(void *p, size_t bytes) {
+    if (p) munmap(p, bytes);
+}
+
+static size_t ring_bytes(uint32_t cap) {
+    return sizeof(ShmRing) + sizeof(ShmMsg) * (size_t)cap;
+}
+
+ShmRing *ring_new(uint32_t cap) {
+    ShmRing *r = shm_alloc(ring_bytes(cap));
+    if (r) r->mask = cap - 1;
+    return r;
+}
+
+void ring_free(ShmRing *r) {
+    if (r) shm_free(r, ring_bytes(r->mask + 1));
+}
+
+void ring_push(ShmRing *r, const ShmMsg *m) {
+    uint32_t t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    while (t - atomic_load_explicit(&r->head, memory_order_acquire) > r->mask) sched_yield();
+    r->slot[t & r->mask] = *m;
+    atomic_store_explicit(&r->tail, t + 1, memory_order_release);
+}
+
+int ring_pop(ShmRing *r, ShmMsg *m) {
+    uint32_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (h == atomic_load_explicit(&r->tail, memory_order_acquire)) return 0;
+    *m = r->slot[h & r->mask];
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+    return 1;
+}
+
+// Polls before sleeping, enough to catch a partner that is about to post
+#define SPIN_POLLS 200
+
+// Shared futex, not FUTEX_PRIVATE_FLAG, the words live in memory other processes map
+static void futex_wait(_Atomic uint32_t *w, uint32_t seen, const struct timespec *ts) {
+    syscall(SYS_futex, (uint32_t *)w, FUTEX_WAIT, seen, ts, NULL, 0);
+}
+
+int shm_wait_for(_Atomic uint32_t *w, uint32_t v, long ns) {
+    for (int i = 0; i < SPIN_POLLS; ++i)
+        if (atomic_load_explicit(w, memory_order_acquire) == v) return 1;
+    uint32_t seen = atomic_load_explicit(w, memory_order_acquire);
+    if (seen == v) return 1;
+    struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+    // returns at once if the word moved off seen since the load
+    futex_wait(w, seen, ns >= 0 ? &ts : NULL);
+    return atomic_load_explicit(w, memory_order_acquire) == v;
+}
+
+void shm_wait(_Atomic uint32_t *w, uint32_t v) {
+    while (!shm_wait_for(w, v, -1)) {}
+}
+
+void shm_post(_Atomic uint32_t *w, uint32_t v) {
+    atomic_store_explicit(w, v, memory_order_release);
+    syscall(SYS_futex, (uint32_t *)w, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
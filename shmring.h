@@ -0,0 +1,60 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Shared memory between forked processes
+ *
+ * Mappings come from shm_alloc before fork, so every process sees them at
+ * the same address and pointers inside stay valid. A ShmRing is a single
+ * producer, single consumer queue of fixed size messages; the producer
+ * spins while it is full. Messages carry ids, never pointers, so the same
+ * traffic could later cross a socket. ShmCtl is the per worker handshake
+ * the coordinator uses to start a step and learn that it finished.
+ *
+ * Waiting spins a short while, then sleeps on a futex on the word, so a
+ * process with nothing to do costs no cpu until the word is posted.
+ */
+
+typedef struct {
+    int kind, phase, node;
+    int a, b, c;
+} ShmMsg;
+
+typedef struct {
+    _Atomic uint32_t head;      // next slot to read, written by the consumer
+    _Atomic uint32_t tail;      // next slot to write, written by the producer
+    uint32_t mask;
+    ShmMsg slot[];
+} ShmRing;
+
+typedef struct {
+    _Atomic uint32_t go;        // step number posted by the coordinator
+    _Atomic uint32_t done;      // last step the worker finished
+    _Atomic int quit;
+    int progress;               // result of the step, read after done
+    int steps;                  // steps the worker ran
+    long long cpu_ns;           // worker cpu time so far
+} ShmCtl;
+
+// Zeroed shared anonymous mapping, NULL on failure
+void *shm_alloc(size_t bytes);
+void shm_free(void *p, size_t bytes);
+
+// Ring of cap messages, cap a power of two
+ShmRing *ring_new(uint32_t cap);
+void ring_free(ShmRing *r);
+void ring_push(ShmRing *r, const ShmMsg *m);
+// Take one message, returns zero when the ring is empty
+int ring_pop(ShmRing *r, ShmMsg *m);
+
+// Block until *w equals v
+void shm_wait(_Atomic uint32_t *w, uint32_t v);
+// Same for at most ns nanoseconds, returns nonzero once *w equals v
+int shm_wait_for(_Atomic uint32_t *w, uint32_t v, long ns);
+// Store v to *w and wake its waiters
+void shm_post(_Atomic uint32_t *w, uint32_t v);
+
+#endif
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "store.h"
+
+uint64_t store_hash(uint64_t h, const void *p, size_t n) {
+    const unsigned char *s = p;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= s[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+int store_open(const char *dir) {
+    if (mkdir(dir, 0777) == 0 || errno == EEXIST) return 0;
+    return -1;
+}
+
+static void blob_path(char *out, size_t cap, const char *dir, const char *suffix, uint64_t key) {
+    snprintf(out, cap, "%s/%016llx%s", dir, (unsigned long long)key, suffix);
+}
+
+int store_put(const char *dir, const char *suffix, uint64_t key, const void *data, size_t len) {
+    char path[4096], tmp[4096 + 32];
+    blob_path(path, sizeof path, dir, suffix, key);
+    snprintf(tmp, sizeof tmp, "%s.%d.tmp", path, (int)getpid());
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return -1;
+    int bad = fwrite(data, 1, len, f) != len;
+    bad |= fclose(f) != 0;
+    if (bad || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return store_touch(dir, suffix, key);
+}
+
+void *store_get(const char *dir, const char *suffix, uint64_t key, size_t *len) {
+    char path[4096];
+    blob_path(path, sizeof path, dir, suffix, key);
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    char *data = NULL;
+    long n = -1;
+    if (fseek(f, 0, SEEK_END) == 0 && (n = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0)
+        data = malloc(n ? (size_t)n : 1);
+    if (data && fread(data, 1, (size_t)n, f) != (size_t)n) { free(data); data = NULL; }
+    fclose(f);
+    if (data) *len = (size_t)n;
+    return data;
+}
+
+long store_read(const char *dir, const char *suffix, uint64_t key, void *buf, size_t cap) {
+    char path[4096];
+    blob_path(path, sizeof path, dir, suffix, key);
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    size_t n = fread(buf, 1, cap, f);
+    fclose(f);
+    return (long)n;
+}
+
+uint64_t *store_keys(const char *dir, const char *suffix, int *n) {
+    *n = 0;
+    DIR *d = opendir(dir);
+    if (!d) return NULL;
+    uint64_t *keys = NULL;
+    int cap = 0;
+    size_t sl = strlen(suffix);
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        // sixteen hex digits, then exactly the suffix
+        if (strlen(e->d_name) != 16 + sl || strcmp(e->d_name + 16, suffix) != 0) continue;
+        char hex[17];
+        memcpy(hex, e->d_name, 16);
+        hex[16] = 0;
+        char *end;
+        uint64_t k = strtoull(hex, &end, 16);
+        if (*end) continue;
+        if (*n == cap) {
+            cap = cap ? cap * 2 : 16;
+            uint64_t *nk = realloc(keys, cap * sizeof *keys);
+            if (!nk) break;
+            keys = nk;
+        }
+        keys[(*n)++] = k;
+    }
+    closedir(d);
+    return keys;
+}
+
+int store_touch(const char *dir, const char *suffix, uint64_t key) {
+    char path[4096];
+    blob_path(path, sizeof path, dir, suffix, key);
+    // the kernel stamps files from a coarse clock, two quick uses could tie
+    struct timespec now[2];
+    clock_gettime(CLOCK_REALTIME, &now[0]);
+    now[1] = now[0];
+    return utimensat(AT_FDCWD, path, now, 0);
+}
+
+typedef struct {
+    uint64_t key;
+    long long bytes;
+    struct timespec used;
+} Entry;
+
+static int older(const void *a, const void *b) {
+    const struct timespec *x = &((const Entry *)a)->used, *y = &((const Entry *)b)->used;
+    if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+void store_trim(const char *dir, const char *suffix, long long max, long long *bytes, int *count) {
+    int n;
+    uint64_t *keys = store_keys(dir, suffix, &n);
+    Entry *e = calloc(n ? n : 1, sizeof *e);
+    long long total = 0;
+    int m = 0;
+    for (int i = 0; e && i < n; ++i) {
+        char path[4096];
+        struct stat st;
+        blob_path(path, sizeof path, dir, suffix, keys[i]);
+        if (stat(path, &st) != 0) continue;
+        e[m].key = keys[i];
+        e[m].bytes = st.st_size;
+        e[m].used = st.st_mtim;
+        total += st.st_size;
+        m++;
+    }
+    if (e) qsort(e, m, sizeof *e, older);
+    int i = 0;
+    for (; i < m && total > max; ++i) {
+        char path[4096];
+        blob_path(path, sizeof path, dir, suffix, e[i].key);
+        if (unlink(path) == 0) total -= e[i].bytes;
+    }
+    *bytes = total;
+    *count = m - i;
+    free(e);
+    free(keys);
+}
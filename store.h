@@ -0,0 +1,47 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Keyed blob store in a directory
+ *
+ * Each blob is one file named by its 64 bit key in hex plus a suffix that
+ * says what kind of blob it is, so several kinds can share a directory.
+ * A put writes a temporary file and renames it over the final name, so a
+ * reader sees the old blob or the new one, never half of either, and a
+ * crashed writer leaves no partial blob behind. Keys come from
+ * store_hash, FNV-1a over whatever the caller feeds it.
+ *
+ * A blob's modification time is its last use: store_touch renews it on
+ * a read and store_trim drops the oldest blobs of a kind first.
+ */
+
+#define STORE_HASH_INIT 0xcbf29ce484222325ULL
+
+// Fold n bytes at p into h
+uint64_t store_hash(uint64_t h, const void *p, size_t n);
+
+// Create dir if it is missing, zero on success
+int store_open(const char *dir);
+
+// Write len bytes as the blob for key, zero on success
+int store_put(const char *dir, const char *suffix, uint64_t key, const void *data, size_t len);
+
+// Blob for key in a malloc'd buffer, NULL when absent or unreadable
+void *store_get(const char *dir, const char *suffix, uint64_t key, size_t *len);
+
+// Read at most cap bytes from the start of the blob for key, bytes read or -1 when absent
+long store_read(const char *dir, const char *suffix, uint64_t key, void *buf, size_t cap);
+
+// Keys of every blob with suffix in a malloc'd array, count in *n
+uint64_t *store_keys(const char *dir, const char *suffix, int *n);
+
+// Mark the blob for key as just used, zero on success
+int store_touch(const char *dir, const char *suffix, uint64_t key);
+
+// Delete the least recently used blobs with suffix until the rest fit in max
+// bytes, the bytes and blobs kept go to *bytes and *count
+void store_trim(const char *dir, const char *suffix, long long max, long long *bytes, int *count);
+
+#endif
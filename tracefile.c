@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "tracefile.h"
+#include "lz.h"
+
+#define TF_QUEUE 4   // filled blocks waiting for the compressor thread
+
+// Per node summary of the block being filled
+typedef struct {
+    int present;
+    int t_min, t_max;
+    uint32_t lines;
+    uint64_t pids[TF_PID_WORDS];
+} TfNodeSpan;
+
+// One block payload with the spans needed for its index entries
+typedef struct {
+    char *buf; size_t len;
+    uint32_t lines;
+    TfNodeSpan span[TF_MAX_NODES];
+} TfJob;
+
+struct TfWriter {
+    FILE *f;
+    uint64_t offset;           // where the next block header goes
+    int compress;
+    int error;
+
+    TfJob *cur;                // block being filled by the simulation
+
+    // blocks handed to the compressor thread, oldest at head
+    TfJob *queue[TF_QUEUE];
+    int head, count, done;
+    pthread_mutex_t lock;
+    pthread_cond_t  nonempty, nonfull;
+    pthread_t thread;
+    uint8_t *zbuf;             // compressor scratch, owned by the thread
+
+    TfIndexEntry *index; uint32_t entries, cap;
+};
+
+static TfJob *job_new(void) {
+    TfJob *j = calloc(1, sizeof *j);
+    if (j && !(j->buf = malloc(TF_BLOCK_BYTES + 256))) { free(j); j = NULL; }
+    return j;
+}
+
+static void job_free(TfJob *j) {
+    if (j) free(j->buf);
+    free(j);
+}
+
+static int tf_write(TfWriter *w, const void *p, size_t n) {
+    if (n && fwrite(p, 1, n, w->f) != n) return -1;
+    w->offset += n;
+    return 0;
+}
+
+// Encode and write one block then add one index entry per node seen in it
+// Runs on the compressor thread when compression is on, inline otherwise
+static int tf_commit(TfWriter *w, TfJob *j) {
+    uint64_t at = w->offset;
+    TfBlockHeader bh = { (uint32_t)j->len, (uint32_t)j->len, TF_BLOCK_PLAIN, j->lines };
+    const void *payload = j->buf;
+    if (w->compress) {
+        size_t z = lz_compress((const uint8_t *)j->buf, j->len, w->zbuf, LZ_BOUND(TF_BLOCK_BYTES + 256));
+        if (z && z < j->len) {
+            bh.stored_len = (uint32_t)z;
+            bh.flags = TF_BLOCK_LZ;
+            payload = w->zbuf;
+        }
+    }
+    if (tf_write(w, &bh, sizeof bh) != 0 || tf_write(w, payload, bh.stored_len) != 0) return -1;
+
+    for (int n = 0; n < TF_MAX_NODES; ++n) {
+        TfNodeSpan *s = &j->span[n];
+        if (!s->present) continue;
+        if (w->entries == w->cap) {
+            uint32_t cap = w->cap ? w->cap * 2 : 256;
+            TfIndexEntry *ni = realloc(w->index, cap * sizeof *ni);
+            if (!ni) return -1;
+            w->index = ni; w->cap = cap;
+        }
+        TfIndexEntry *e = &w->index[w->entries++];
+        memset(e, 0, sizeof *e);
+        e->offset = at;
+        e->node = n;
+        e->t_min = s->t_min; e->t_max = s->t_max;
+        e->lines = s->lines;
+        memcpy(e->pids, s->pids, sizeof e->pids);
+    }
+    return 0;
+}
+
+// Compressor thread drains the queue in order so file offsets stay sequential
+static void *tf_compressor(void *arg) {
+    TfWriter *w = arg;
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        while (w->count == 0 && !w->done) pthread_cond_wait(&w->nonempty, &w->lock);
+        if (w->count == 0) { pthread_mutex_unlock(&w->lock); break; }
+        TfJob *j = w->queue[w->head];
+        pthread_mutex_unlock(&w->lock);
+
+        // the slot stays taken while we work so the producer cannot run ahead by more than TF_QUEUE
+        if (!w->error && tf_commit(w, j) != 0) w->error = 1;
+        job_free(j);
+
+        pthread_mutex_lock(&w->lock);
+        w->head = (w->head + 1) % TF_QUEUE;
+        w->count--;
+        pthread_cond_signal(&w->nonfull);
+        pthread_mutex_unlock(&w->lock);
+    }
+    return NULL;
+}
+
+size_t tf_buffer_bytes(int compress) {
+    size_t job = sizeof(TfJob) + TF_BLOCK_BYTES + 256;
+    if (!compress) return sizeof(TfWriter) + job;
+    // block being filled, the queue and the one the compressor holds
+    return sizeof(TfWriter) + (TF_QUEUE + 2) * job + LZ_BOUND(TF_BLOCK_BYTES + 256);
+}
+
+TfWriter *tf_open(const char *path, int compress) {
+    TfWriter *w = calloc(1, sizeof *w);
+    if (!w) return NULL;
+    w->compress = compress;
+    w->cur = job_new();
+    w->f = fopen(path, "wb");
+    uint32_t hdr[2] = { TF_MAGIC, TF_VERSION };
+    if (!w->cur || !w->f || tf_write(w, hdr, sizeof hdr) != 0) goto bad;
+    if (compress) {
+        if (!(w->zbuf = malloc(LZ_BOUND(TF_BLOCK_BYTES + 256)))) goto bad;
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->nonempty, NULL);
+        pthread_cond_init(&w->nonfull, NULL);
+        if (pthread_create(&w->thread, NULL, tf_compressor, w) != 0) goto bad;
+    }
+    return w;
+bad:
+    if (w->f) fclose(w->f);
+    job_free(w->cur); free(w->zbuf); free(w);
+    return NULL;
+}
+
+// Hand the filled block off and start a fresh one
+static int tf_submit(TfWriter *w) {
+    if (w->cur->len == 0) return 0;
+    if (!w->compress) {
+        int rc = tf_commit(w, w->cur);
+        TfJob *j = w->cur;
+        j->len = 0; j->lines = 0;
+        memset(j->span, 0, sizeof j->span);
+        return rc;
+    }
+    TfJob *next = job_new();
+    if (!next) return -1;
+    pthread_mutex_lock(&w->lock);
+    while (w->count == TF_QUEUE) pthread_cond_wait(&w->nonfull, &w->lock);
+    w->queue[(w->head + w->count) % TF_QUEUE] = w->cur;
+    w->count++;
+    pthread_cond_signal(&w->nonempty);
+    pthread_mutex_unlock(&w->lock);
+    w->cur = next;
+    return w->error ? -1 : 0;
+}
+
+int tf_event(TfWriter *w, int node, int time, int pid, const char *line, size_t len) {
+    if (node < 0 || node >= TF_MAX_NODES || len > 256) return -1;
+    TfJob *j = w->cur;
+    memcpy(j->buf + j->len, line, len);
+    j->len += len;
+    j->lines++;
+
+    TfNodeSpan *s = &j->span[node];
+    if (!s->present) { s->present = 1; s->t_min = s->t_max = time; }
+    if (time < s->t_min) s->t_min = time;
+    if (time > s->t_max) s->t_max = time;
+    s->lines++;
+    if (pid >= 0 && pid < 64 * TF_PID_WORDS) s->pids[pid >> 6] |= 1ULL << (pid & 63);
+
+    if (j->len >= TF_BLOCK_BYTES) return tf_submit(w);
+    return 0;
+}
+
+int tf_close(TfWriter *w) {
+    int rc = tf_submit(w);
+    if (w->compress) {
+        pthread_mutex_lock(&w->lock);
+        w->done = 1;
+        pthread_cond_signal(&w->nonempty);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->thread, NULL);
+        if (w->error) rc = -1;
+    }
+    TfFooter ft = { w->offset, w->entries, TF_INDEX_MAGIC };
+    if (rc == 0) rc = tf_write(w, w->index, (size_t)w->entries * sizeof *w->index);
+    if (rc == 0) rc = tf_write(w, &ft, sizeof ft);
+    if (fclose(w->f) != 0) rc = -1;
+    job_free(w->cur); free(w->zbuf); free(w->index); free(w);
+    return rc;
+}
+
+int tf_read_open(TfReader *r, const char *path) {
+    memset(r, 0, sizeof *r);
+    uint32_t hdr[2];
+    TfFooter ft;
+    if (!(r->f = fopen(path, "rb"))) return -1;
+    if (fread(hdr, sizeof hdr, 1, r->f) != 1 || hdr[0] != TF_MAGIC || hdr[1] != TF_VERSION) goto bad;
+    if (fseek(r->f, -(long)sizeof ft, SEEK_END) != 0 || fread(&ft, sizeof ft, 1, r->f) != 1) goto bad;
+    if (ft.magic != TF_INDEX_MAGIC) goto bad;
+    r->entries = ft.entries;
+    r->index = malloc((size_t)ft.entries * sizeof *r->index + 1);
+    if (!r->index || fseek(r->f, (long)ft.index_offset, SEEK_SET) != 0) goto bad;
+    if (ft.entries && fread(r->index, sizeof *r->index, ft.entries, r->f) != ft.entries) goto bad;
+    return 0;
+bad:
+    tf_read_close(r);
+    return -1;
+}
+
+void tf_read_close(TfReader *r) {
+    if (r->f) fclose(r->f);
+    free(r->index);
+    memset(r, 0, sizeof *r);
+}
+
+char *tf_read_block(TfReader *r, uint64_t offset, size_t *len) {
+    TfBlockHeader bh;
+    if (fseek(r->f, (long)offset, SEEK_SET) != 0 || fread(&bh, sizeof bh, 1, r->f) != 1) return NULL;
+    if (bh.flags == TF_BLOCK_PLAIN && bh.stored_len != bh.raw_len) return NULL;
+    if (bh.flags != TF_BLOCK_PLAIN && bh.flags != TF_BLOCK_LZ) return NULL;
+
+    char *buf = malloc(bh.raw_len + 1);
+    char *stored = bh.flags == TF_BLOCK_LZ ? malloc(bh.stored_len + 1) : buf;
+    if (!buf || !stored) goto bad;
+    if (bh.stored_len && fread(stored, 1, bh.stored_len, r->f) != bh.stored_len) goto bad;
+    if (bh.flags == TF_BLOCK_LZ) {
+        if (lz_decompress((const uint8_t *)stored, bh.stored_len, (uint8_t *)buf, bh.raw_len) != 0) goto bad;
+        free(stored);
+    }
+    *len = bh.raw_len;
+    return buf;
+bad:
+    if (stored != buf) free(stored);
+    free(buf);
+    return NULL;
+}
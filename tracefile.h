@@ -0,0 +1,76 @@
+#ifndef TRACEFILE_H
+#define TRACEFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Block structured trace file with a sparse time index
+ *
+ *   header   "PTRC" magic, version
+ *   blocks   TfBlockHeader then payload of trace text lines
+ *   index    one TfIndexEntry per node present in each block
+ *   footer   index offset, entry count, "PIDX" magic
+ *
+ * Lines of one node are in time order, so (node, t_min, t_max) per block
+ * lets a reader seek straight to the blocks that cover a window.
+ */
+
+#define TF_MAGIC        0x43525450u   // "PTRC"
+#define TF_INDEX_MAGIC  0x58444950u   // "PIDX"
+#define TF_VERSION      1u
+#define TF_BLOCK_BYTES  (64 * 1024)   // payload size that closes a block
+#define TF_MAX_NODES    128           // nodes tracked per block
+#define TF_PID_WORDS    2             // pid bitmap words, pids below 128
+
+// Block payload encodings
+#define TF_BLOCK_PLAIN  0u
+#define TF_BLOCK_LZ     1u            // lz.h codec, see lz_decompress
+
+typedef struct {
+    uint32_t raw_len;      // payload bytes once decoded
+    uint32_t stored_len;   // payload bytes on disk
+    uint32_t flags;        // payload encoding, TF_BLOCK_PLAIN or TF_BLOCK_LZ
+    uint32_t lines;
+} TfBlockHeader;
+
+typedef struct {
+    uint64_t offset;       // file offset of TfBlockHeader
+    int32_t  node;
+    int32_t  t_min, t_max;
+    uint32_t lines;        // lines of this node in the block
+    uint64_t pids[TF_PID_WORDS];
+} TfIndexEntry;
+
+typedef struct {
+    uint64_t index_offset;
+    uint32_t entries;
+    uint32_t magic;
+} TfFooter;
+
+// Writer side
+typedef struct TfWriter TfWriter;
+
+// With compress set, full blocks are LZ encoded and written by a helper
+// thread so encoding overlaps with the caller producing the next block
+TfWriter *tf_open(const char *path, int compress);
+// Append one trace line, len bytes including its newline
+int  tf_event(TfWriter *w, int node, int time, int pid, const char *line, size_t len);
+// Flush the open block, write index and footer, free the writer
+int  tf_close(TfWriter *w);
+// Most bytes of block buffers a writer holds at once, the index comes on top
+size_t tf_buffer_bytes(int compress);
+
+// Reader side
+typedef struct {
+    FILE *f;
+    TfIndexEntry *index;
+    uint32_t entries;
+} TfReader;
+
+int  tf_read_open(TfReader *r, const char *path);
+void tf_read_close(TfReader *r);
+// Load and decode the block at offset, returns a malloc buffer of *len bytes
+// or NULL when the block is unreadable or corrupt
+char *tf_read_block(TfReader *r, uint64_t offset, size_t *len);
+
+#endif
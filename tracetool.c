@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "tracefile.h"
+
+/* Query a trace written by prosim --trace-file
+ * Only blocks whose index entries overlap the query are read.
+ */
+
+static int q_node = -1, q_pid = -1;
+static int q_lo = 0, q_hi = 0x3fffffff;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "usage: %s [options] trace-file\n"
+        "  -n, --node N        lines of node N only\n"
+        "  -p, --pid P         lines of pid P within node only\n"
+        "  -w, --window A-B    lines with A <= time <= B (B may be omitted)\n"
+        "  -i, --index         print the block index instead of lines\n",
+        prog);
+}
+
+// Does index entry e hold lines this query may want
+static int entry_wanted(const TfIndexEntry *e) {
+    if (q_node >= 0 && e->node != q_node) return 0;
+    if (e->t_max < q_lo || e->t_min > q_hi) return 0;
+    if (q_pid >= 0) {
+        if (q_pid >= 64 * TF_PID_WORDS) return 1;
+        if (!((e->pids[q_pid >> 6] >> (q_pid & 63)) & 1)) return 0;
+    }
+    return 1;
+}
+
+// Print lines of one decoded block that pass the query
+static void emit_block(const char *p, size_t len) {
+    const char *end = p + len;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        size_t n = nl ? (size_t)(nl - p) + 1 : (size_t)(end - p);
+        int node, time, pid;
+        if (sscanf(p, "[%d] %d: process %d", &node, &time, &pid) == 3
+            && (q_node < 0 || node == q_node)
+            && (q_pid < 0 || pid == q_pid)
+            && time >= q_lo && time <= q_hi)
+            fwrite(p, 1, n, stdout);
+        p += n;
+    }
+}
+
+int main(int argc, char **argv) {
+    static const struct option longopts[] = {
+        { "node",   required_argument, NULL, 'n' },
+        { "pid",    required_argument, NULL, 'p' },
+        { "window", required_argument, NULL, 'w' },
+        { "index",  no_argument,       NULL, 'i' },
+        { "help",   no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int show_index = 0, c;
+    while ((c = getopt_long(argc, argv, "n:p:w:ih", longopts, NULL)) != -1) {
+        switch (c) {
+        case 'n': q_node = atoi(optarg); break;
+        case 'p': q_pid = atoi(optarg); break;
+        case 'w': {
+            char *end;
+            q_lo = (int)strtol(optarg, &end, 10);
+            if (*end == '-' && end[1]) q_hi = (int)strtol(end + 1, NULL, 10);
+            else if (*end != '-') q_hi = q_lo;
+            break;
+        }
+        case 'i': show_index = 1; break;
+        case 'h': usage(argv[0]); return 0;
+        default:  usage(argv[0]); return 2;
+        }
+    }
+    if (optind != argc - 1) { usage(argv[0]); return 2; }
+
+    TfReader r;
+    if (tf_read_open(&r, argv[optind]) != 0) {
+        fprintf(stderr, "tracetool: %s is not a readable trace file\n", argv[optind]);
+        return 1;
+    }
+
+    if (show_index) {
+        printf("offset,node,t_min,t_max,lines\n");
+        for (uint32_t i = 0; i < r.entries; ++i) {
+            TfIndexEntry *e = &r.index[i];
+            if (entry_wanted(e))
+                printf("%llu,%d,%d,%d,%u\n", (unsigned long long)e->offset,
+                       e->node, e->t_min, e->t_max, e->lines);
+        }
+        tf_read_close(&r);
+        return 0;
+    }
+
+    // Entries of one block are adjacent, so decode each wanted block once
+    int rc = 0;
+    uint64_t last = (uint64_t)-1;
+    for (uint32_t i = 0; i < r.entries; ++i) {
+        TfIndexEntry *e = &r.index[i];
+        if (e->offset == last || !entry_wanted(e)) continue;
+        last = e->offset;
+        size_t len;
+        char *blk = tf_read_block(&r, e->offset, &len);
+        if (!blk) {
+            fprintf(stderr, "tracetool: bad block at offset %llu\n", (unsigned long long)e->offset);
+            rc = 1;
+            break;
+        }
+        emit_block(blk, len);
+        free(blk);
+    }
+    tf_read_close(&r);
+    return rc;
+}